@@ -4,6 +4,7 @@ IF NOT DEFINED ZAR_TOOLCHAIN SET ZAR_TOOLCHAIN=msvc
 IF NOT DEFINED ZAR_BUILDDIR SET ZAR_BUILDDIR=obj
 
 CALL .\ninja\make-zlib.cmd
+CALL .\ninja\make-xz.cmd
 
 DEL build.ninja
 REM copy in binary mode to avoid a trailing EOF ^Z.
@@ -0,0 +1,21 @@
+
+@IF NOT DEFINED ZAR_BUILDDIR (
+    @ECHO Must define ZAR_BUILDDIR to use %0
+    GOTO :eof
+)
+@IF NOT DEFINED ZAR_TOOLCHAIN (
+    @ECHO Must define ZAR_TOOLCHAIN to use %0
+    GOTO :eof
+)
+
+IF EXIST %ZAR_BUILDDIR%\lzma.lib GOTO :eof
+
+git submodule init
+git submodule update
+
+MKDIR %ZAR_BUILDDIR%
+
+REM Only liblzma, static, and none of the xz tools.
+cmake -S xz -B %ZAR_BUILDDIR%\xz -DBUILD_SHARED_LIBS=OFF
+cmake --build %ZAR_BUILDDIR%\xz --config Release --target liblzma
+COPY /B /Y %ZAR_BUILDDIR%\xz\Release\liblzma.lib %ZAR_BUILDDIR%\lzma.lib
@@ -0,0 +1,33 @@
+#!/bin/sh
+set -e
+
+name="$(basename $0)"
+
+if [ -z "$ZAR_BUILDDIR" -o -z "$ZAR_TOOLCHAIN" ]; then
+    echo "$name: must set ZAR_BUILDDIR and ZAR_TOOLCHAIN to use $0"
+    exit 1
+fi
+
+builddir="${ZAR_BUILDDIR}"
+toolchain="${ZAR_TOOLCHAIN}"
+
+if [ -f "$builddir/xz/liblzma.a" ]; then
+    exit 0
+fi
+
+echo "$name: Making liblzma using ZAR_TOOLCHAIN=$toolchain under ZAR_BUILDDIR=$builddir"
+mkdir -p "$builddir"
+
+git submodule init
+git submodule update
+
+# Only liblzma, static, and none of the xz tools.
+echo "$name: Running cmake."
+cmake -S xz -B "$builddir/xz" -DCMAKE_C_COMPILER="$toolchain" \
+    -DCMAKE_BUILD_TYPE=Release -DBUILD_SHARED_LIBS=OFF
+
+echo "$name: Building."
+cmake --build "$builddir/xz" --target liblzma
+
+echo "$name: Use -Ixz/src/liblzma/api for finding headers."
+echo "$name: Use $builddir/xz/liblzma.a for linking."
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "arena.h"
+
+#include "debug.h"
+#include "sysexits.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+void arena_init(ZarArena* arena)
+{
+	memset(arena, 0, sizeof(*arena));
+}
+
+
+void arena_free(ZarArena* arena)
+{
+	free(arena->data);
+	free(arena->offsets);
+	memset(arena, 0, sizeof(*arena));
+}
+
+
+size_t arena_add(ZarArena* arena, const char* str)
+{
+	size_t n = strlen(str) + 1;
+	if (arena->length + n > arena->capacity) {
+		size_t capacity = arena->capacity ? arena->capacity : 4096;
+		while (capacity < arena->length + n)
+			capacity *= 2;
+		char* p = realloc(arena->data, capacity);
+		if (p == NULL)
+			error(EX_OSERR, "unable to grow string arena to %zu bytes", capacity);
+		arena->data = p;
+		arena->capacity = capacity;
+	}
+	if (arena->count == arena->maxcount) {
+		size_t maxcount = arena->maxcount ? 2 * arena->maxcount : 64;
+		size_t* p = realloc(arena->offsets, maxcount * sizeof(size_t));
+		if (p == NULL)
+			error(EX_OSERR, "unable to grow string arena to %zu strings", maxcount);
+		arena->offsets = p;
+		arena->maxcount = maxcount;
+	}
+
+	memcpy(arena->data + arena->length, str, n);
+	arena->offsets[arena->count] = arena->length;
+	arena->length += n;
+	return arena->count++;
+}
+
+
+const char* arena_get(const ZarArena* arena, size_t i)
+{
+	return arena->data + arena->offsets[i];
+}
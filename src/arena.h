@@ -0,0 +1,47 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZAR_SRC_ARENA__H
+#define ZAR_SRC_ARENA__H
+
+#include <stddef.h>
+
+/** Strings packed end to end in one buffer, found by number.
+ *
+ * Costs the strings themselves plus an offset apiece, instead of a fixed
+ * ZAR_MAX_PATH buffer and a malloc() per string. Both arrays grow
+ * geometrically. Adding a string may move the buffer, so pointers from
+ * arena_get() are only good until the next arena_add().
+ */
+typedef struct {
+	char* data;
+	size_t length;
+	size_t capacity;
+	/* Where each string starts in data. */
+	size_t* offsets;
+	size_t count;
+	size_t maxcount;
+} ZarArena;
+
+void arena_init(ZarArena* arena);
+void arena_free(ZarArena* arena);
+
+/** Copies str into the arena. Returns its number. */
+size_t arena_add(ZarArena* arena, const char* str);
+
+/** String number i. */
+const char* arena_get(const ZarArena* arena, size_t i);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "chunk.h"
+
+#include "debug.h"
+#include "sysexits.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+ * A gear hash: each byte shifts the hash left and adds a random number for
+ * that byte, so a bit depends on as many of the latest bytes as it is from
+ * the bottom. Testing the top bits therefore looks at the last 64 bytes.
+ */
+static uint64_t gear[256];
+
+/* Top 13 bits: a cut about every 8K past CHUNK_MIN. */
+#define CHUNK_MASK (~UINT64_C(0) << (64 - 13))
+
+
+/* splitmix64, to fill the table the same way every time. */
+static uint64_t next_random(uint64_t* state)
+{
+	uint64_t z = (*state += UINT64_C(0x9E3779B97F4A7C15));
+	z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+	return z ^ (z >> 31);
+}
+
+
+void chunk_init(void)
+{
+	uint64_t state = 0;
+	for (size_t i=0; i < 256; ++i)
+		gear[i] = next_random(&state);
+}
+
+
+size_t chunk_cut(const unsigned char* data, size_t n)
+{
+	if (n <= CHUNK_MIN)
+		return n;
+	size_t limit = n < CHUNK_MAX ? n : CHUNK_MAX;
+
+	uint64_t hash = 0;
+	for (size_t i=CHUNK_MIN; i < limit; ++i) {
+		hash = (hash << 1) + gear[data[i]];
+		if ((hash & CHUNK_MASK) == 0)
+			return i + 1;
+	}
+	return limit;
+}
+
+
+/* A word at a time: multiply, then fold the high bits back down. */
+uint64_t chunk_hash(const void* data, size_t n)
+{
+	const uint64_t prime = UINT64_C(0x9E3779B97F4A7C15);
+	const unsigned char* p = data;
+	uint64_t h = (uint64_t)n * prime;
+
+	for (; n >= 8; p += 8, n -= 8) {
+		uint64_t w;
+		memcpy(&w, p, sizeof(w));
+		h = (h ^ w) * prime;
+		h ^= h >> 29;
+	}
+	for (; n > 0; ++p, --n) {
+		h = (h ^ *p) * prime;
+		h ^= h >> 29;
+	}
+	h ^= h >> 32;
+	h *= UINT64_C(0xD6E8FEB86659FD93);
+	return h ^ (h >> 32);
+}
+
+
+struct ChunkEntry {
+	uint64_t hash;
+	CRC32_t crc;
+	uint32_t length;
+	/* -1 if the bucket is empty. */
+	ZarOffset_t offset;
+};
+
+
+struct ZarChunkIndex_t {
+	/* Open addressing with linear probing, kept at most half full. */
+	size_t count;
+	size_t nbuckets;
+	struct ChunkEntry* buckets;
+};
+
+
+static struct ChunkEntry* allocate_buckets(size_t n)
+{
+	struct ChunkEntry* buckets = malloc(n * sizeof(struct ChunkEntry));
+	if (buckets == NULL)
+		error(EX_OSERR, "unable to allocate chunk index of %zu buckets", n);
+	for (size_t i=0; i < n; ++i)
+		buckets[i].offset = -1;
+	return buckets;
+}
+
+
+ZarChunkIndex* chunk_index_create(void)
+{
+	ZarChunkIndex* index = malloc(sizeof(ZarChunkIndex));
+	if (index == NULL)
+		error(EX_OSERR, "%s(): unable allocate memory.", __func__);
+	index->count = 0;
+	index->nbuckets = 1024;
+	index->buckets = allocate_buckets(index->nbuckets);
+	return index;
+}
+
+
+void chunk_index_free(ZarChunkIndex* index)
+{
+	if (index == NULL)
+		return;
+	debug("chunk index: %zu chunks in %zu buckets", index->count, index->nbuckets);
+	free(index->buckets);
+	free(index);
+}
+
+
+static struct ChunkEntry* find_bucket(const ZarChunkIndex* index, uint64_t hash, CRC32_t crc, size_t length)
+{
+	size_t mask = index->nbuckets - 1;
+	for (size_t b = (size_t)hash & mask; ; b = (b + 1) & mask) {
+		struct ChunkEntry* e = &index->buckets[b];
+		if (e->offset < 0 || (e->hash == hash && e->crc == crc && e->length == length))
+			return e;
+	}
+}
+
+
+ZarOffset_t chunk_index_find(const ZarChunkIndex* index, uint64_t hash, CRC32_t crc, size_t length)
+{
+	return find_bucket(index, hash, crc, length)->offset;
+}
+
+
+void chunk_index_add(ZarChunkIndex* index, uint64_t hash, CRC32_t crc, size_t length, ZarOffset_t offset)
+{
+	if (2 * (index->count + 1) > index->nbuckets) {
+		struct ChunkEntry* old = index->buckets;
+		size_t n = index->nbuckets;
+		index->nbuckets *= 2;
+		index->buckets = allocate_buckets(index->nbuckets);
+		for (size_t i=0; i < n; ++i) {
+			if (old[i].offset >= 0)
+				*find_bucket(index, old[i].hash, old[i].crc, old[i].length) = old[i];
+		}
+		free(old);
+	}
+
+	struct ChunkEntry* e = find_bucket(index, hash, crc, length);
+	if (e->offset < 0)
+		index->count++;
+	e->hash = hash;
+	e->crc = crc;
+	e->length = (uint32_t)length;
+	e->offset = offset;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZAR_SRC_CHUNK__H
+#define ZAR_SRC_CHUNK__H
+
+#include "io.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bounds on the chunks chunk_cut() picks. They average about 10K. */
+#define CHUNK_MIN (2 * 1024)
+#define CHUNK_MAX (64 * 1024)
+
+/** Builds the table the rolling hash uses.
+ *
+ * Must be called once, before chunk_cut() and before any threads are started.
+ */
+void chunk_init(void);
+
+/** Length of the chunk at the start of data, which has n bytes.
+ *
+ * Cuts fall where the content says, so an edit only moves the chunks around
+ * it and the rest come out the same. Returns n if n is no more than
+ * CHUNK_MIN, and never more than CHUNK_MAX. Unless data runs to the end of
+ * the input, n must be at least CHUNK_MAX.
+ */
+size_t chunk_cut(const unsigned char* data, size_t n);
+
+/** 64 bit fingerprint of a chunk, to go with its CRC-32. */
+uint64_t chunk_hash(const void* data, size_t n);
+
+/** Hash table of the chunks stored so far, and where they were stored.
+ *
+ * A chunk is known by its fingerprint, CRC-32 and length together.
+ */
+typedef struct ZarChunkIndex_t ZarChunkIndex;
+
+ZarChunkIndex* chunk_index_create(void);
+void chunk_index_free(ZarChunkIndex* index);
+
+/** Where an identical chunk was stored, or -1 if there isn't one. */
+ZarOffset_t chunk_index_find(const ZarChunkIndex* index, uint64_t hash, CRC32_t crc, size_t length);
+
+/** Remember a chunk was stored at offset. */
+void chunk_index_add(ZarChunkIndex* index, uint64_t hash, CRC32_t crc, size_t length, ZarOffset_t offset);
+
+#endif
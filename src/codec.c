@@ -0,0 +1,505 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "codec.h"
+
+#include "debug.h"
+#include "io.h"
+#include "lz.h"
+#include "sysexits.h"
+
+#include "lzma.h"
+#include "zlib.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* State every codec starts with: an output buffer of zar_tunables.block_size. */
+struct CodecBuffer {
+	const char* name;
+	unsigned char* data;
+	size_t size;
+};
+
+
+static void buffer_init(struct CodecBuffer* buffer, const char* name)
+{
+	buffer->name = name;
+	buffer->size = zar_tunables.block_size;
+	buffer->data = malloc(buffer->size);
+	if (buffer->data == NULL)
+		error(EX_OSERR, "%s: unable to allocate %zu byte codec buffer", name, buffer->size);
+}
+
+
+/* Raw: the data is its own encoding. */
+
+static void* raw_init(bool compress, int level, const char* name)
+{
+	(void)compress;
+	(void)level;
+	(void)name;
+	return NULL;
+}
+
+
+static void raw_compress_block(void* state, const void* in, size_t n, bool last,
+                               ZarCodecOutput output, void* context)
+{
+	(void)state;
+	(void)last;
+	if (n > 0)
+		output(context, in, n);
+}
+
+
+/* Raw data ends wherever its record says it does. */
+static bool raw_decompress_block(void* state, const void* in, size_t n, size_t* used,
+                                 ZarCodecOutput output, void* context)
+{
+	(void)state;
+	if (n > 0)
+		output(context, in, n);
+	*used = n;
+	return true;
+}
+
+
+static void raw_finish(void* state)
+{
+	(void)state;
+}
+
+
+/* Deflate: a raw stream, without a zlib header or trailer. We keep our own CRC. */
+
+struct DeflateState {
+	struct CodecBuffer buffer;
+	bool compress;
+	z_stream z;
+};
+
+
+static void* deflate_init(bool compress, int level, const char* name)
+{
+	struct DeflateState* state = calloc(1, sizeof(*state));
+	if (state == NULL)
+		error(EX_OSERR, "%s: unable to allocate deflate state", name);
+	buffer_init(&state->buffer, name);
+	state->compress = compress;
+
+	int status = compress
+	           ? deflateInit2(&state->z, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY)
+	           : inflateInit2(&state->z, -MAX_WBITS);
+	if (status != Z_OK)
+		error(EX_SOFTWARE, "%s: %s() failed: %s", name,
+		      compress ? "deflateInit2" : "inflateInit2", state->z.msg);
+	return state;
+}
+
+
+static void deflate_compress_block(void* opaque, const void* in, size_t n, bool last,
+                                   ZarCodecOutput output, void* context)
+{
+	struct DeflateState* state = opaque;
+	struct CodecBuffer* buffer = &state->buffer;
+	z_stream* z = &state->z;
+	int flush = last ? Z_FINISH : Z_NO_FLUSH;
+
+	z->next_in = (Bytef*)in;
+	z->avail_in = (uInt)n;
+	do {
+		z->next_out = buffer->data;
+		z->avail_out = (uInt)buffer->size;
+		if (deflate(z, flush) == Z_STREAM_ERROR)
+			error(EX_SOFTWARE, "%s: deflate() failed: %s", buffer->name, z->msg);
+		size_t have = buffer->size - z->avail_out;
+		if (have > 0)
+			output(context, buffer->data, have);
+	} while (z->avail_out == 0);
+}
+
+
+static bool deflate_decompress_block(void* opaque, const void* in, size_t n, size_t* used,
+                                     ZarCodecOutput output, void* context)
+{
+	struct DeflateState* state = opaque;
+	struct CodecBuffer* buffer = &state->buffer;
+	z_stream* z = &state->z;
+
+	z->next_in = (Bytef*)in;
+	z->avail_in = (uInt)n;
+	int status;
+	do {
+		z->next_out = buffer->data;
+		z->avail_out = (uInt)buffer->size;
+		status = inflate(z, Z_NO_FLUSH);
+		/* A buffer error only says there was nothing to do. */
+		if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR)
+			error(EX_DATAERR, "%s: failed inflating: %s", buffer->name, z->msg ? z->msg : "corrupt data");
+		size_t have = buffer->size - z->avail_out;
+		if (have > 0)
+			output(context, buffer->data, have);
+	} while (status != Z_STREAM_END && z->avail_out == 0);
+
+	*used = n - z->avail_in;
+	return status == Z_STREAM_END;
+}
+
+
+static void deflate_finish(void* opaque)
+{
+	struct DeflateState* state = opaque;
+	if (state->compress)
+		deflateEnd(&state->z);
+	else
+		inflateEnd(&state->z);
+	free(state->buffer.data);
+	free(state);
+}
+
+
+/*
+ * XZ: a whole .xz stream, as xz(1) would write it, except without a check
+ * of its own since records have a CRC-32. Slow and hungry, but it packs
+ * tightest, which suits archives that go into cold storage.
+ */
+
+struct XzState {
+	struct CodecBuffer buffer;
+	lzma_stream s;
+	/* Compressing, the encoder waits for the first block. */
+	bool started;
+	uint32_t preset;
+};
+
+
+static void* xz_init(bool compress, int level, const char* name)
+{
+	struct XzState* state = calloc(1, sizeof(*state));
+	if (state == NULL)
+		error(EX_OSERR, "%s: unable to allocate xz state", name);
+	buffer_init(&state->buffer, name);
+	lzma_stream blank = LZMA_STREAM_INIT;
+	state->s = blank;
+
+	state->preset = level < 0 ? LZMA_PRESET_DEFAULT : (uint32_t)level;
+	if (!compress) {
+		lzma_ret status = lzma_stream_decoder(&state->s, UINT64_MAX, 0);
+		if (status != LZMA_OK)
+			error(EX_SOFTWARE, "%s: failed starting liblzma (error %d)", name, (int)status);
+		state->started = true;
+	}
+	return state;
+}
+
+
+/*
+ * The higher presets have dictionaries of megabytes, and setting up the match
+ * finder for one costs more than compressing a small file. When the first
+ * block is the whole file, the dictionary needn't be any bigger than it.
+ */
+static void xz_start_encoder(struct XzState* state, size_t n, bool last)
+{
+	lzma_options_lzma options;
+	if (lzma_lzma_preset(&options, state->preset))
+		error(EX_SOFTWARE, "%s: no xz preset %u", state->buffer.name, (unsigned)state->preset);
+	if (last && n < options.dict_size)
+		options.dict_size = n < LZMA_DICT_SIZE_MIN ? LZMA_DICT_SIZE_MIN : (uint32_t)n;
+
+	lzma_filter filters[] = {
+		{ LZMA_FILTER_LZMA2, &options },
+		{ LZMA_VLI_UNKNOWN, NULL },
+	};
+	lzma_ret status = lzma_stream_encoder(&state->s, filters, LZMA_CHECK_NONE);
+	if (status != LZMA_OK)
+		error(EX_SOFTWARE, "%s: failed starting liblzma (error %d)", state->buffer.name, (int)status);
+	state->started = true;
+}
+
+
+static void xz_compress_block(void* opaque, const void* in, size_t n, bool last,
+                              ZarCodecOutput output, void* context)
+{
+	struct XzState* state = opaque;
+	struct CodecBuffer* buffer = &state->buffer;
+	lzma_stream* s = &state->s;
+	lzma_action action = last ? LZMA_FINISH : LZMA_RUN;
+	if (!state->started)
+		xz_start_encoder(state, n, last);
+
+	s->next_in = in;
+	s->avail_in = n;
+	lzma_ret status;
+	do {
+		s->next_out = buffer->data;
+		s->avail_out = buffer->size;
+		status = lzma_code(s, action);
+		if (status != LZMA_OK && status != LZMA_STREAM_END)
+			error(EX_SOFTWARE, "%s: xz compression failed (error %d)", buffer->name, (int)status);
+		size_t have = buffer->size - s->avail_out;
+		if (have > 0)
+			output(context, buffer->data, have);
+	} while (last ? status != LZMA_STREAM_END : s->avail_out == 0);
+}
+
+
+static bool xz_decompress_block(void* opaque, const void* in, size_t n, size_t* used,
+                                ZarCodecOutput output, void* context)
+{
+	struct XzState* state = opaque;
+	struct CodecBuffer* buffer = &state->buffer;
+	lzma_stream* s = &state->s;
+
+	s->next_in = in;
+	s->avail_in = n;
+	lzma_ret status;
+	do {
+		s->next_out = buffer->data;
+		s->avail_out = buffer->size;
+		status = lzma_code(s, LZMA_RUN);
+		/* A buffer error only says there was nothing to do. */
+		if (status != LZMA_OK && status != LZMA_STREAM_END && status != LZMA_BUF_ERROR)
+			error(EX_DATAERR, "%s: failed decompressing xz data (error %d)", buffer->name, (int)status);
+		size_t have = buffer->size - s->avail_out;
+		if (have > 0)
+			output(context, buffer->data, have);
+	} while (status != LZMA_STREAM_END && s->avail_out == 0);
+
+	*used = n - s->avail_in;
+	return status == LZMA_STREAM_END;
+}
+
+
+static void xz_finish(void* opaque)
+{
+	struct XzState* state = opaque;
+	lzma_end(&state->s);
+	free(state->buffer.data);
+	free(state);
+}
+
+
+/*
+ * LZ: see lz.h. The data is cut into blocks of up to LZ_BLOCK_SIZE that are
+ * compressed on their own. Each is its length and the length stored, as 32 bit
+ * little endian, then the data, which is stored as it is if it didn't shrink.
+ * An empty block ends the stream.
+ */
+
+#define LZ_BLOCK_SIZE (1024 * 1024)
+#define LZ_HEADER_SIZE 8
+
+struct LzState {
+	const char* name;
+	/* Compressing, where matches are looked up. */
+	uint32_t* table;
+	/*
+	 * The block being written, or the block being read, header and all,
+	 * when it didn't arrive in one piece. have says how much of it has.
+	 */
+	unsigned char* block;
+	size_t have;
+	/* Decompressing, the block decoded. */
+	unsigned char* out;
+};
+
+
+static void put32(unsigned char* p, uint32_t v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+}
+
+
+static uint32_t get32(const unsigned char* p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static void* lz_init(bool compress, int level, const char* name)
+{
+	(void)level;
+	struct LzState* state = calloc(1, sizeof(*state));
+	if (state == NULL)
+		error(EX_OSERR, "%s: unable to allocate lz state", name);
+	state->name = name;
+	state->block = malloc(LZ_HEADER_SIZE + LZ_BOUND(LZ_BLOCK_SIZE));
+	if (compress)
+		state->table = calloc(LZ_HASH_SIZE, sizeof(*state->table));
+	else
+		state->out = malloc(LZ_BLOCK_SIZE);
+	if (state->block == NULL || (compress ? state->table == NULL : state->out == NULL))
+		error(EX_OSERR, "%s: unable to allocate lz buffers", name);
+	return state;
+}
+
+
+static void lz_compress_block(void* opaque, const void* in, size_t n, bool last,
+                              ZarCodecOutput output, void* context)
+{
+	struct LzState* state = opaque;
+	const unsigned char* data = in;
+	for (size_t done = 0; done < n; ) {
+		size_t size = n - done > LZ_BLOCK_SIZE ? LZ_BLOCK_SIZE : n - done;
+		size_t stored = lz_compress(data + done, size, state->block + LZ_HEADER_SIZE, state->table);
+		bool shrank = stored < size;
+		put32(state->block, (uint32_t)size);
+		put32(state->block + 4, (uint32_t)(shrank ? stored : size));
+		if (shrank) {
+			output(context, state->block, LZ_HEADER_SIZE + stored);
+		} else {
+			output(context, state->block, LZ_HEADER_SIZE);
+			output(context, data + done, size);
+		}
+		done += size;
+	}
+	if (last) {
+		unsigned char end[LZ_HEADER_SIZE] = { 0 };
+		output(context, end, sizeof(end));
+	}
+}
+
+
+/* Pass on the block whose header is in state->block and whose data is at data. */
+static void lz_output_block(struct LzState* state, const unsigned char* data,
+                            ZarCodecOutput output, void* context)
+{
+	size_t size = get32(state->block);
+	size_t stored = get32(state->block + 4);
+	if (stored == size) {
+		output(context, data, size);
+		return;
+	}
+	if (!lz_decompress(data, stored, state->out, size))
+		error(EX_DATAERR, "%s: corrupt lz data", state->name);
+	output(context, state->out, size);
+}
+
+
+static bool lz_decompress_block(void* opaque, const void* in, size_t n, size_t* used,
+                                ZarCodecOutput output, void* context)
+{
+	struct LzState* state = opaque;
+	const unsigned char* p = in;
+	size_t left = n;
+
+	while (left > 0) {
+		if (state->have < LZ_HEADER_SIZE) {
+			size_t take = LZ_HEADER_SIZE - state->have;
+			if (take > left)
+				take = left;
+			memcpy(state->block + state->have, p, take);
+			state->have += take;
+			p += take;
+			left -= take;
+			if (state->have < LZ_HEADER_SIZE)
+				break;
+
+			size_t size = get32(state->block);
+			size_t stored = get32(state->block + 4);
+			if (size == 0 && stored == 0) {
+				*used = n - left;
+				return true;
+			}
+			if (size == 0 || size > LZ_BLOCK_SIZE || stored == 0 || stored > size)
+				error(EX_DATAERR, "%s: corrupt lz block header", state->name);
+			continue;
+		}
+
+		/* Straight from the input if it's all there, or else once it's been gathered. */
+		size_t stored = get32(state->block + 4);
+		if (state->have == LZ_HEADER_SIZE && left >= stored) {
+			lz_output_block(state, p, output, context);
+			p += stored;
+			left -= stored;
+			state->have = 0;
+			continue;
+		}
+		size_t take = LZ_HEADER_SIZE + stored - state->have;
+		if (take > left)
+			take = left;
+		memcpy(state->block + state->have, p, take);
+		state->have += take;
+		p += take;
+		left -= take;
+		if (state->have == LZ_HEADER_SIZE + stored) {
+			lz_output_block(state, state->block + LZ_HEADER_SIZE, output, context);
+			state->have = 0;
+		}
+	}
+
+	*used = n - left;
+	return false;
+}
+
+
+static void lz_finish(void* opaque)
+{
+	struct LzState* state = opaque;
+	free(state->table);
+	free(state->block);
+	free(state->out);
+	free(state);
+}
+
+
+const ZarCodec codec_raw = {
+	"raw", { 0x00, 0x00 },
+	raw_init, raw_compress_block, raw_decompress_block, raw_finish
+};
+
+const ZarCodec codec_deflate = {
+	"deflate", { 'D', 'F' },
+	deflate_init, deflate_compress_block, deflate_decompress_block, deflate_finish
+};
+
+const ZarCodec codec_xz = {
+	"xz", { 'X', 'Z' },
+	xz_init, xz_compress_block, xz_decompress_block, xz_finish
+};
+
+const ZarCodec codec_lz = {
+	"lz", { 'L', 'Z' },
+	lz_init, lz_compress_block, lz_decompress_block, lz_finish
+};
+
+static const ZarCodec* const codecs[] = { &codec_raw, &codec_deflate, &codec_xz, &codec_lz };
+
+
+const ZarCodec* codec_find(const char format[2])
+{
+	for (size_t i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++) {
+		if (codecs[i]->format[0] == format[0] && codecs[i]->format[1] == format[1])
+			return codecs[i];
+	}
+	return NULL;
+}
+
+
+const ZarCodec* codec_named(const char* name)
+{
+	for (size_t i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++) {
+		if (strcmp(codecs[i]->name, name) == 0)
+			return codecs[i];
+	}
+	return NULL;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZAR_SRC_CODEC__H
+#define ZAR_SRC_CODEC__H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Where a codec hands its output, a piece at a time. */
+typedef void (*ZarCodecOutput)(void* context, const void* data, size_t n);
+
+/** A way of storing file data, known by the two format bytes of its records.
+ *
+ * Data goes through a block at a time in either direction, and whatever
+ * comes out is passed to an output callback as it's ready. name is only used
+ * for error messages. Corrupt input calls error().
+ */
+typedef struct ZarCodec_t {
+	/* What --codec calls it. */
+	const char* name;
+	char format[2];
+
+	/** Start compressing at level, 0-9 or -1 for the codec's default, or decompressing. */
+	void* (*init)(bool compress, int level, const char* name);
+
+	/** Compress n bytes of in. The last call, which may have no data, says so. */
+	void (*compress_block)(void* state, const void* in, size_t n, bool last,
+	                       ZarCodecOutput output, void* context);
+
+	/** Decompress n bytes of in.
+	 *
+	 * Sets *used to how much of the input it took, which is all of it unless
+	 * the stream ended first. Returns true once it has.
+	 */
+	bool (*decompress_block)(void* state, const void* in, size_t n, size_t* used,
+	                         ZarCodecOutput output, void* context);
+
+	/** Release the state init() returned. */
+	void (*finish)(void* state);
+} ZarCodec;
+
+extern const ZarCodec codec_raw;
+extern const ZarCodec codec_deflate;
+extern const ZarCodec codec_xz;
+extern const ZarCodec codec_lz;
+
+/** The codec for a record's format bytes, or NULL if there isn't one. */
+const ZarCodec* codec_find(const char format[2]);
+
+/** The codec --codec name picks, or NULL if there isn't one. */
+const ZarCodec* codec_named(const char* name);
+
+#endif
@@ -0,0 +1,387 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "crc.h"
+
+#include "debug.h"
+
+#include "zlib.h"
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CRC_PCLMUL
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CRC_TARGET
+#else
+#include <cpuid.h>
+#define CRC_TARGET __attribute__((target("pclmul,sse2")))
+#endif
+#elif defined(__aarch64__) && (defined(__linux__) || defined(__APPLE__))
+#define CRC_PMULL
+#include <arm_neon.h>
+#ifdef __linux__
+#include <sys/auxv.h>
+#ifndef HWCAP_PMULL
+#define HWCAP_PMULL (1 << 4)
+#endif
+#endif
+#ifdef __clang__
+#define CRC_TARGET __attribute__((target("aes")))
+#else
+#define CRC_TARGET __attribute__((target("+crypto")))
+#endif
+#endif
+
+
+/* zlib's polynomial, bit reflected. */
+#define POLY 0xedb88320
+
+/* x2n_table[k] is x^(2^k) modulo POLY, for crc_combine(). */
+static uint32_t x2n_table[32];
+
+
+/* zlib's crc32() is table driven and already about as fast as tables get. */
+static CRC32_t crc_update_zlib(CRC32_t crc, const unsigned char* p, size_t length)
+{
+	while (length > 0) {
+		uInt n = length > (1u << 30) ? (1u << 30) : (uInt)length;
+		crc = (CRC32_t)crc32(crc, p, n);
+		p += n;
+		length -= n;
+	}
+	return crc;
+}
+
+
+/*
+ * Carry-less multiplication folding, from Intel's "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction". The constants are the
+ * bit reflected ones for zlib's polynomial given at the end of that paper.
+ *
+ * fold_*() take and return the raw CRC register, without the inversions
+ * done by crc_update(). length must be at least 64 and a multiple of 16.
+ */
+#if defined(CRC_PCLMUL) || defined(CRC_PMULL)
+static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+#endif
+
+
+#ifdef CRC_PCLMUL
+
+CRC_TARGET static uint32_t fold_pclmul(uint32_t crc, const unsigned char* p, size_t length)
+{
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i*)(p + 0x00));
+	x2 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+	x3 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+	x4 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	p += 64;
+	length -= 64;
+
+	/* Fold four lanes 64 bytes at a time. */
+	x0 = _mm_loadu_si128((const __m128i*)k1k2);
+	while (length >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(p + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(p + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(p + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(p + 0x30)));
+		p += 64;
+		length -= 64;
+	}
+
+	/* Fold the four lanes into one. */
+	x0 = _mm_loadu_si128((const __m128i*)k3k4);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	/* Then whatever 16 byte blocks are left. */
+	while (length >= 16) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)p)), x5);
+		p += 16;
+		length -= 16;
+	}
+
+	/* 128 bits down to 64. */
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, x3), x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32. */
+	x0 = _mm_loadu_si128((const __m128i*)poly);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, x3), x0, 0x10);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, x3), x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+
+static bool have_pclmul(void)
+{
+	unsigned int regs[4] = { 0 };
+#ifdef _MSC_VER
+	__cpuid((int*)regs, 1);
+#else
+	if (!__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]))
+		return false;
+#endif
+	/* ECX bit 1 is PCLMULQDQ, EDX bit 26 SSE2. */
+	return (regs[2] & (1 << 1)) && (regs[3] & (1 << 26));
+}
+
+#define fold_accelerated fold_pclmul
+#define have_accelerated have_pclmul
+#define ACCELERATED_NAME "pclmul"
+
+#endif /* CRC_PCLMUL */
+
+
+#ifdef CRC_PMULL
+
+/* a.lo * b.lo */
+CRC_TARGET static inline uint64x2_t clmul_00(uint64x2_t a, uint64x2_t b)
+{
+	return vreinterpretq_u64_p128(vmull_p64((poly64_t)vgetq_lane_u64(a, 0),
+	                                         (poly64_t)vgetq_lane_u64(b, 0)));
+}
+
+/* a.hi * b.hi */
+CRC_TARGET static inline uint64x2_t clmul_11(uint64x2_t a, uint64x2_t b)
+{
+	return vreinterpretq_u64_p128(vmull_p64((poly64_t)vgetq_lane_u64(a, 1),
+	                                         (poly64_t)vgetq_lane_u64(b, 1)));
+}
+
+/* a.lo * b.hi */
+CRC_TARGET static inline uint64x2_t clmul_10(uint64x2_t a, uint64x2_t b)
+{
+	return vreinterpretq_u64_p128(vmull_p64((poly64_t)vgetq_lane_u64(a, 0),
+	                                         (poly64_t)vgetq_lane_u64(b, 1)));
+}
+
+CRC_TARGET static inline uint64x2_t load_128(const unsigned char* p)
+{
+	return vreinterpretq_u64_u8(vld1q_u8(p));
+}
+
+/* Like _mm_srli_si128(): shift right by whole bytes, shifting in zeros. */
+#define shift_right_bytes(x, n) \
+	vreinterpretq_u64_u8(vextq_u8(vreinterpretq_u8_u64(x), vdupq_n_u8(0), n))
+
+/* Same steps as fold_pclmul(). */
+CRC_TARGET static uint32_t fold_pmull(uint32_t crc, const unsigned char* p, size_t length)
+{
+	uint64x2_t x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = load_128(p + 0x00);
+	x2 = load_128(p + 0x10);
+	x3 = load_128(p + 0x20);
+	x4 = load_128(p + 0x30);
+	x1 = veorq_u64(x1, vsetq_lane_u64(crc, vdupq_n_u64(0), 0));
+	p += 64;
+	length -= 64;
+
+	x0 = vld1q_u64(k1k2);
+	while (length >= 64) {
+		x5 = clmul_00(x1, x0);
+		x6 = clmul_00(x2, x0);
+		x7 = clmul_00(x3, x0);
+		x8 = clmul_00(x4, x0);
+		x1 = clmul_11(x1, x0);
+		x2 = clmul_11(x2, x0);
+		x3 = clmul_11(x3, x0);
+		x4 = clmul_11(x4, x0);
+		x1 = veorq_u64(veorq_u64(x1, x5), load_128(p + 0x00));
+		x2 = veorq_u64(veorq_u64(x2, x6), load_128(p + 0x10));
+		x3 = veorq_u64(veorq_u64(x3, x7), load_128(p + 0x20));
+		x4 = veorq_u64(veorq_u64(x4, x8), load_128(p + 0x30));
+		p += 64;
+		length -= 64;
+	}
+
+	x0 = vld1q_u64(k3k4);
+	x5 = clmul_00(x1, x0);
+	x1 = clmul_11(x1, x0);
+	x1 = veorq_u64(veorq_u64(x1, x2), x5);
+	x5 = clmul_00(x1, x0);
+	x1 = clmul_11(x1, x0);
+	x1 = veorq_u64(veorq_u64(x1, x3), x5);
+	x5 = clmul_00(x1, x0);
+	x1 = clmul_11(x1, x0);
+	x1 = veorq_u64(veorq_u64(x1, x4), x5);
+
+	while (length >= 16) {
+		x5 = clmul_00(x1, x0);
+		x1 = clmul_11(x1, x0);
+		x1 = veorq_u64(veorq_u64(x1, load_128(p)), x5);
+		p += 16;
+		length -= 16;
+	}
+
+	x3 = vdupq_n_u64(0xffffffff);
+	x2 = clmul_10(x1, x0);
+	x1 = veorq_u64(shift_right_bytes(x1, 8), x2);
+	x0 = vld1q_u64(k5k0);
+	x2 = shift_right_bytes(x1, 4);
+	x1 = clmul_00(vandq_u64(x1, x3), x0);
+	x1 = veorq_u64(x1, x2);
+
+	x0 = vld1q_u64(poly);
+	x2 = clmul_10(vandq_u64(x1, x3), x0);
+	x2 = clmul_00(vandq_u64(x2, x3), x0);
+	x1 = veorq_u64(x1, x2);
+
+	return (uint32_t)(vgetq_lane_u64(x1, 0) >> 32);
+}
+
+
+static bool have_pmull(void)
+{
+#ifdef __linux__
+	return (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0;
+#else
+	/* Every 64-bit Apple CPU has it. */
+	return true;
+#endif
+}
+
+#define fold_accelerated fold_pmull
+#define have_accelerated have_pmull
+#define ACCELERATED_NAME "pmull"
+
+#endif /* CRC_PMULL */
+
+
+#ifdef ACCELERATED_NAME
+static CRC32_t crc_update_accelerated(CRC32_t crc, const unsigned char* p, size_t length)
+{
+	if (length >= 64) {
+		size_t n = length & ~(size_t)15;
+		crc = ~fold_accelerated(~crc, p, n);
+		p += n;
+		length -= n;
+	}
+	return crc_update_zlib(crc, p, length);
+}
+#endif
+
+
+static CRC32_t (*crc_function)(CRC32_t crc, const unsigned char* p, size_t length) = crc_update_zlib;
+static const char* crc_name = "zlib";
+
+
+/* a * b modulo POLY, with bit 31 being x^0. */
+static uint32_t multmodp(uint32_t a, uint32_t b)
+{
+	uint32_t m = (uint32_t)1 << 31;
+	uint32_t p = 0;
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0)
+				break;
+		}
+		m >>= 1;
+		b = b & 1 ? (b >> 1) ^ POLY : b >> 1;
+	}
+	return p;
+}
+
+
+void crc_init(void)
+{
+	uint32_t p = (uint32_t)1 << 30; /* x^1 */
+	for (int k = 0; k < 32; ++k) {
+		x2n_table[k] = p;
+		p = multmodp(p, p);
+	}
+
+#ifdef ACCELERATED_NAME
+	if (have_accelerated()) {
+		/* Cheap insurance against a broken compiler or CPU: check every
+		 * length up to a few turns of both folding loops against zlib. */
+		unsigned char sample[256];
+		for (size_t i = 0; i < sizeof(sample); ++i)
+			sample[i] = (unsigned char)(i * 167 + 13);
+		bool ok = true;
+		for (size_t n = 0; n <= sizeof(sample) && ok; ++n)
+			ok = crc_update_accelerated(0, sample, n) == crc_update_zlib(0, sample, n);
+		if (ok) {
+			crc_function = crc_update_accelerated;
+			crc_name = ACCELERATED_NAME;
+		} else {
+			warn("crc: %s self test failed, using zlib", ACCELERATED_NAME);
+		}
+	}
+#endif
+	debug("crc: using %s", crc_name);
+}
+
+
+const char* crc_implementation(void)
+{
+	return crc_name;
+}
+
+
+CRC32_t crc_update(CRC32_t crc, const void* data, size_t length)
+{
+	if (length == 0)
+		return crc;
+	return crc_function(crc, data, length);
+}
+
+
+CRC32_t crc_combine(CRC32_t crc_a, CRC32_t crc_b, int64_t length_b)
+{
+	/* Multiply crc_a by x^(8 * length_b), one bit of length_b at a time. */
+	uint32_t p = (uint32_t)1 << 31;
+	for (unsigned k = 3; length_b > 0; length_b >>= 1, ++k) {
+		if (length_b & 1)
+			p = multmodp(x2n_table[k & 31], p);
+	}
+	return multmodp(p, crc_a) ^ crc_b;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZAR_SRC_CRC__H
+#define ZAR_SRC_CRC__H
+
+#include "io.h"
+
+#include <stddef.h>
+
+/** Builds the tables and picks the fastest CRC-32 code this CPU can run.
+ *
+ * Must be called once, before any other crc_ function and before any
+ * threads are started.
+ */
+void crc_init(void);
+
+/** Name of the code crc_update() is using, for debug output. */
+const char* crc_implementation(void);
+
+/** Continues crc over length bytes of data.
+ *
+ * Same polynomial and conditioning as zlib's crc32(), so start with 0. Unlike
+ * crc32(), length isn't limited to what a uInt can count.
+ */
+CRC32_t crc_update(CRC32_t crc, const void* data, size_t length);
+
+/** CRC of A followed by B, given the CRCs of both and B's length. */
+CRC32_t crc_combine(CRC32_t crc_a, CRC32_t crc_b, int64_t length_b);
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dircache.h"
+
+#include "debug.h"
+#include "io.h"
+#include "sysexits.h"
+#include "system.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+struct ZarDirCache_t {
+	size_t count;
+	/* Open addressing with linear probing. Owned paths, or NULL if empty. */
+	size_t nbuckets;
+	char** buckets;
+};
+
+
+/* FNV-1a, like the member index. */
+static uint64_t hash_path(const char* path)
+{
+	uint64_t h = UINT64_C(14695981039346656037);
+	for (const unsigned char* p = (const unsigned char*)path; *p != '\0'; ++p) {
+		h ^= *p;
+		h *= UINT64_C(1099511628211);
+	}
+	return h;
+}
+
+
+/* The bucket holding path, or the empty one it would go in. */
+static char** find_bucket(char** buckets, size_t nbuckets, const char* path)
+{
+	size_t mask = nbuckets - 1;
+	for (size_t i = (size_t)hash_path(path) & mask; ; i = (i + 1) & mask) {
+		if (buckets[i] == NULL || strcmp(buckets[i], path) == 0)
+			return &buckets[i];
+	}
+}
+
+
+static void grow(ZarDirCache* cache)
+{
+	size_t nbuckets = 2 * cache->nbuckets;
+	char** buckets = calloc(nbuckets, sizeof(char*));
+	if (buckets == NULL)
+		error(EX_OSERR, "unable to grow directory cache to %zu buckets", nbuckets);
+	for (size_t i=0; i < cache->nbuckets; ++i) {
+		if (cache->buckets[i] != NULL)
+			*find_bucket(buckets, nbuckets, cache->buckets[i]) = cache->buckets[i];
+	}
+	free(cache->buckets);
+	cache->buckets = buckets;
+	cache->nbuckets = nbuckets;
+}
+
+
+static void insert(ZarDirCache* cache, const char* path)
+{
+	/* Keep the table at most half full so probes stay short. */
+	if (2 * (cache->count + 1) > cache->nbuckets)
+		grow(cache);
+	char** bucket = find_bucket(cache->buckets, cache->nbuckets, path);
+	*bucket = malloc(strlen(path) + 1);
+	if (*bucket == NULL)
+		error(EX_OSERR, "%s(): unable allocate memory.", __func__);
+	strcpy(*bucket, path);
+	cache->count++;
+}
+
+
+ZarDirCache* dircache_create(void)
+{
+	ZarDirCache* cache = malloc(sizeof(ZarDirCache));
+	if (cache == NULL)
+		error(EX_OSERR, "%s(): unable allocate memory.", __func__);
+	cache->count = 0;
+	cache->nbuckets = 64;
+	cache->buckets = calloc(cache->nbuckets, sizeof(char*));
+	if (cache->buckets == NULL)
+		error(EX_OSERR, "%s(): unable allocate memory.", __func__);
+	return cache;
+}
+
+
+void dircache_free(ZarDirCache* cache)
+{
+	if (cache == NULL)
+		return;
+	for (size_t i=0; i < cache->nbuckets; ++i)
+		free(cache->buckets[i]);
+	free(cache->buckets);
+	free(cache);
+}
+
+
+/* Make path, a directory, after its parents. path is cut short and restored. */
+static int make_dirs(ZarDirCache* cache, char* path)
+{
+	if (*path == '\0' || strcmp(path, ".") == 0)
+		return 0;
+	if (*find_bucket(cache->buckets, cache->nbuckets, path) != NULL)
+		return 0;
+
+	char* slash = strrchr(path, '/');
+	if (slash != NULL) {
+		*slash = '\0';
+		int status = make_dirs(cache, path);
+		*slash = '/';
+		if (status != 0)
+			return status;
+	}
+
+	xtrace("dircache: making %s", path);
+	if (system_mkdir_one(path) != 0)
+		return -1;
+	insert(cache, path);
+	return 0;
+}
+
+
+int dircache_make_parent(ZarDirCache* cache, const char* file)
+{
+	char dir[ZAR_MAX_PATH];
+	size_t length = strlen(file);
+	if (length >= sizeof(dir)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memcpy(dir, file, length + 1);
+
+	char* slash = strrchr(dir, '/');
+	if (slash == NULL)
+		return 0;
+	*slash = '\0';
+	return make_dirs(cache, dir);
+}
+
+
+size_t dircache_count(const ZarDirCache* cache)
+{
+	return cache->count;
+}
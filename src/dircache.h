@@ -0,0 +1,40 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZAR_SRC_DIRCACHE__H
+#define ZAR_SRC_DIRCACHE__H
+
+#include <stddef.h>
+
+/** Remembers which directories have been made, so each is made only once.
+ *
+ * Not thread safe: make every directory before starting workers.
+ */
+typedef struct ZarDirCache_t ZarDirCache;
+
+ZarDirCache* dircache_create(void);
+void dircache_free(ZarDirCache* cache);
+
+/** Makes the directory that file is in, and any missing parents.
+ *
+ * Directories the cache has seen before cost nothing. Returns 0 on success,
+ * or -1 with errno set if a mkdir() failed.
+ */
+int dircache_make_parent(ZarDirCache* cache, const char* file);
+
+/** How many directories have been made or found to exist. */
+size_t dircache_count(const ZarDirCache* cache);
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "index.h"
+
+#include "debug.h"
+#include "sysexits.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+struct ZarIndex_t {
+	const ZarRecordTable* table;
+	/* Open addressing with linear probing. Row + 1, or 0 if empty. */
+	size_t nbuckets;
+	size_t* buckets;
+};
+
+
+/* FNV-1a: simple and good enough for paths. */
+static uint64_t hash_path(const char* path)
+{
+	uint64_t h = UINT64_C(14695981039346656037);
+	for (const unsigned char* p = (const unsigned char*)path; *p != '\0'; ++p) {
+		h ^= *p;
+		h *= UINT64_C(1099511628211);
+	}
+	return h;
+}
+
+
+ZarIndex* index_create(const ZarRecordTable* table)
+{
+	ZarIndex* index = malloc(sizeof(ZarIndex));
+	if (index == NULL)
+		error(EX_OSERR, "%s(): unable allocate memory.", __func__);
+
+	/* Keep the table at most half full so probes stay short. */
+	size_t nbuckets = 16;
+	while (nbuckets < 2 * table->count)
+		nbuckets *= 2;
+
+	index->table = table;
+	index->nbuckets = nbuckets;
+	index->buckets = calloc(nbuckets, sizeof(size_t));
+	if (index->buckets == NULL)
+		error(EX_OSERR, "unable to allocate index for %zu members", table->count);
+
+	size_t mask = nbuckets - 1;
+	for (size_t row=0; row < table->count; ++row) {
+		const char* path = table->paths[row];
+		size_t b = (size_t)hash_path(path) & mask;
+		while (index->buckets[b] != 0) {
+			if (strcmp(table->paths[index->buckets[b] - 1], path) == 0)
+				break;
+			b = (b + 1) & mask;
+		}
+		index->buckets[b] = row + 1;
+	}
+
+	debug("index: %zu rows in %zu buckets", table->count, nbuckets);
+	return index;
+}
+
+
+void index_free(ZarIndex* index)
+{
+	if (index == NULL)
+		return;
+	free(index->buckets);
+	free(index);
+}
+
+
+size_t index_find(const ZarIndex* index, const char* path)
+{
+	const char** paths = index->table->paths;
+	size_t mask = index->nbuckets - 1;
+	size_t b = (size_t)hash_path(path) & mask;
+	while (index->buckets[b] != 0) {
+		size_t row = index->buckets[b] - 1;
+		if (strcmp(paths[row], path) == 0)
+			return row;
+		b = (b + 1) & mask;
+	}
+	return INDEX_NONE;
+}
+
+
+bool index_is_pattern(const char* path)
+{
+	return strpbrk(path, "*?[") != NULL;
+}
+
+
+/** Match one [...] class at p against c. Returns just past the class, or NULL. */
+static const char* match_class(const char* p, char c, bool* matched)
+{
+	bool negate = (*p == '!' || *p == '^');
+	if (negate)
+		++p;
+
+	*matched = false;
+	const char* start = p;
+	while (*p != '\0' && (*p != ']' || p == start)) {
+		if (p[1] == '-' && p[2] != ']' && p[2] != '\0') {
+			if (c >= p[0] && c <= p[2])
+				*matched = true;
+			p += 3;
+		} else {
+			if (c == *p)
+				*matched = true;
+			++p;
+		}
+	}
+	if (*p != ']')
+		return NULL;
+
+	if (negate)
+		*matched = !*matched;
+	return p + 1;
+}
+
+
+static bool glob(const char* pattern, const char* str)
+{
+	/* Where to resume after the last '*' if what followed it failed. */
+	const char* star = NULL;
+	const char* resume = NULL;
+
+	while (*str != '\0') {
+		bool matched = false;
+		const char* next = pattern + 1;
+
+		if (*pattern == '*') {
+			star = pattern++;
+			resume = str;
+			continue;
+		} else if (*pattern == '?') {
+			matched = true;
+		} else if (*pattern == '[') {
+			next = match_class(pattern + 1, *str, &matched);
+			if (next == NULL) {
+				/* Unterminated class: treat '[' literally. */
+				next = pattern + 1;
+				matched = (*str == '[');
+			}
+		} else if (*pattern != '\0') {
+			matched = (*pattern == *str);
+		}
+
+		if (matched) {
+			pattern = next;
+			++str;
+		} else if (star != NULL) {
+			pattern = star + 1;
+			str = ++resume;
+		} else {
+			return false;
+		}
+	}
+
+	while (*pattern == '*')
+		++pattern;
+	return *pattern == '\0';
+}
+
+
+bool index_glob(const char* pattern, const char* path)
+{
+	return glob(pattern, path);
+}
+
+
+size_t index_match(const ZarIndex* index, const char* pattern,
+                   void (*func)(size_t row, void* context),
+                   void* context)
+{
+	const ZarRecordTable* table = index->table;
+	size_t n = 0;
+	for (size_t row=0; row < table->count; ++row) {
+		if (glob(pattern, table->paths[row])) {
+			func(row, context);
+			++n;
+		}
+	}
+	return n;
+}
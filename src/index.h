@@ -0,0 +1,57 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZAR_SRC_INDEX__H
+#define ZAR_SRC_INDEX__H
+
+#include "io.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Returned by index_find() when there's no such path. */
+#define INDEX_NONE ((size_t)-1)
+
+/** Hash table from member path to row of a volume's ZarRecordTable.
+ *
+ * The index only holds row numbers; the paths stay in the table, which must
+ * outlive the index. If a path is in the table twice, lookups find the later
+ * row.
+ */
+typedef struct ZarIndex_t ZarIndex;
+
+/** Creates an index over every row of table. */
+ZarIndex* index_create(const ZarRecordTable* table);
+void index_free(ZarIndex* index);
+
+/** Exact match lookup. Returns the row, or INDEX_NONE if path isn't in the index. */
+size_t index_find(const ZarIndex* index, const char* path);
+
+/** True if path has any glob characters: *, ? or [. */
+bool index_is_pattern(const char* path);
+
+/** True if path matches the glob pattern. See index_match(). */
+bool index_glob(const char* pattern, const char* path);
+
+/** Calls func on every row whose path matches the glob pattern, in order.
+ *
+ * Supports *, ? and [...] classes. Unlike a shell, * also matches '/'.
+ * Returns the number of matches.
+ */
+size_t index_match(const ZarIndex* index, const char* pattern,
+                   void (*func)(size_t row, void* context),
+                   void* context);
+
+#endif
@@ -16,8 +16,14 @@
 
 #include "io.h"
 
+#include "chunk.h"
+#include "codec.h"
+#include "crc.h"
 #include "debug.h"
-
+#include "dircache.h"
+#include "index.h"
+#include "pool.h"
+#include "table.h"
 #include "sysexits.h"
 #include "system.h"
 
@@ -34,6 +40,82 @@
 static const int32_t zar_start_mark = 0x0052415A;
 /* The inverse but still in little-endian. */
 static const int32_t zar_end_mark = 0x5A415200;
+/* ZIX0 stored in little-endian: the start of the index that ends an archive. */
+static const int32_t zar_index_mark = 0x0058495A;
+/* The inverse, ending the index and so the archive. */
+static const int32_t zar_index_end_mark = 0x5A495800;
+/* tpzar only supports UTF-8, and only in as much as the C library does if even that. */
+static const char zar_filemap_encoding[] = "utf-8";
+
+
+struct ZarTunables zar_tunables = {
+	.block_size = 1024 * 1024,
+	.level = Z_DEFAULT_COMPRESSION,
+	.jobs = 1,
+	.mmap = false,
+	.verify = true,
+	.spill_size = 4 * 1024 * 1024,
+	.chunk_size = 0,
+	.dedup = false,
+	.solid_size = 0,
+	.volume_size = 0,
+	.codec = &codec_deflate,
+};
+
+
+/* Largest distance deflate can refer back to: the most a dictionary is useful for. */
+#define ZAR_DEFLATE_WINDOW 32768
+
+
+/* Format codes for file data. See ZarFileRecord::format. */
+static const char zar_format_raw[2] = { 0x00, 0x00 };
+static const char zar_format_deflate[2] = { 'D', 'F' };
+static const char zar_format_dedup[2] = { 'C', 'D' };
+static const char zar_format_solid[2] = { 'S', 'B' };
+
+
+static inline bool is_format(const ZarFileRecord* record, const char format[2])
+{
+	return record->format[0] == format[0] && record->format[1] == format[1];
+}
+
+
+/** Whether new file data gets compressed at all: --level 0 and --codec raw both store it. */
+static inline bool compressing(void)
+{
+	return zar_tunables.level != 0 && zar_tunables.codec != &codec_raw;
+}
+
+
+/** Bytes from the start of a record of path to the start of its data. */
+static inline ZarOffset_t record_header_size(const char* path)
+{
+	return (ZarOffset_t)sizeof(ZarOffset_t) + (ZarOffset_t)strlen(path) + 1
+	     + 2 + (ZarOffset_t)sizeof(ZarOffset_t);
+}
+
+
+/** Reset every field of record, pointing it at path. */
+static void init_file_record(ZarFileRecord* record, const char* path)
+{
+	record->start = 0;
+	record->offset = 0;
+	record->checksum = 0;
+	record->datasum = 0;
+	record->path = path;
+	record->length = 0;
+	record->format[0] = (char)0xDE;
+	record->format[1] = (char)0xAD;
+}
+
+
+/** The volume's index, built on first use: listing everything never needs it. */
+static ZarIndex* volume_index(ZarVolumeRecord* volume)
+{
+	if (volume->index == NULL)
+		volume->index = index_create(&volume->records);
+	return volume->index;
+}
 
 
 /** Like fgets() but looks for NUL terminator instead of newline.
@@ -69,301 +151,3515 @@ static inline void put_string(const char* str, FILE* file)
  */
 static fpos_t mark_position(ZarHandle* archive)
 {
-	fpos_t m;
-	if (fgetpos(archive->handle, &m) != 0)
-		error(EX_IOERR, "%s: unable to get file positon: %s", archive->path, strerror(errno));
-	return m;
+	fpos_t m;
+	if (fgetpos(archive->handle, &m) != 0)
+		error(EX_IOERR, "%s: unable to get file positon: %s", archive->path, strerror(errno));
+	return m;
+}
+
+
+/*
+ * Split archives.
+ *
+ * Only the part holding the archive's position is open. See ZarHandle::nparts.
+ */
+
+
+/** Name of part n, counting from 1, of the archive named after stem. Must be free()'d. */
+static char* part_path(const char* stem, size_t n)
+{
+	size_t size = strlen(stem) + 24;
+	char* path = malloc(size);
+	if (path == NULL)
+		error(EX_OSERR, "unable to allocate memory");
+	snprintf(path, size, "%s.%03zu", stem, n);
+	return path;
+}
+
+
+/** Add a part of size bytes after the last one. */
+static void add_part(ZarHandle* archive, ZarOffset_t size)
+{
+	ZarOffset_t* starts = realloc(archive->partstarts, (archive->nparts + 2) * sizeof(ZarOffset_t));
+	if (starts == NULL)
+		error(EX_OSERR, "unable to allocate memory");
+	if (archive->nparts == 0)
+		starts[0] = 0;
+	starts[archive->nparts + 1] = starts[archive->nparts] + size;
+	archive->partstarts = starts;
+	archive->nparts++;
+}
+
+
+/** Make part k the open one, opening it with fopen()'s mode. */
+static void open_part(ZarHandle* archive, size_t k, const char* mode)
+{
+	char* path = part_path(archive->stem, k + 1);
+	if (archive->handle != NULL)
+		fclose(archive->handle);
+	archive->handle = fopen(path, mode);
+	if (archive->handle == NULL)
+		error(EX_IOERR, "Failed opening archive part %s (%s)", path, strerror(errno));
+	xtrace("%s: opened part %s", archive->path, path);
+	free(path);
+	archive->part = k;
+	archive->base = archive->partstarts[k];
+}
+
+
+/** The part holding offset: the last one starting at or before it. */
+static size_t find_part(const ZarHandle* archive, ZarOffset_t offset)
+{
+	size_t lo = 0, hi = archive->nparts - 1;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo + 1) / 2;
+		if (archive->partstarts[mid] <= offset)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+
+/** The stem of the split archive archive names, or NULL if it doesn't name one.
+ *
+ * It does if it's the first part, or if there's no such file but there is a
+ * first part named after it. The stem is absolute, and must be free()'d.
+ */
+static char* split_stem(const char* archive)
+{
+	size_t n = strlen(archive);
+	char* first;
+	if (n > 4 && strcmp(archive + n - 4, ".001") == 0) {
+		first = system_realpath(archive);
+	} else if (system_filesize(archive) < 0) {
+		char* path = part_path(archive, 1);
+		first = system_realpath(path);
+		free(path);
+	} else {
+		return NULL;
+	}
+
+	/* Unless a link led somewhere else, the real path is a first part too. */
+	n = first != NULL ? strlen(first) : 0;
+	if (n <= 4 || strcmp(first + n - 4, ".001") != 0) {
+		free(first);
+		return NULL;
+	}
+	first[n - 4] = '\0';
+	return first;
+}
+
+
+/** Open every part of the split archive named after archive->stem, for reading. */
+static void open_split(ZarHandle* archive)
+{
+	for (size_t n=1; ; ++n) {
+		char* path = part_path(archive->stem, n);
+		int64_t size = system_filesize(path);
+		free(path);
+		if (size < 0)
+			break;
+		add_part(archive, size);
+	}
+	open_part(archive, 0, "rb");
+	debug("%s: split into %zu parts, %lld bytes in all", archive->path,
+	      archive->nparts, (long long)archive->partstarts[archive->nparts]);
+}
+
+
+/*
+ * Reading archives.
+ *
+ * When the archive is memory mapped, reads come straight out of the mapping
+ * and archive->cursor tracks the position. Otherwise they go through stdio.
+ */
+
+
+static ZarOffset_t archive_tell(ZarHandle* archive)
+{
+	if (archive->mapping != NULL || archive->stream)
+		return archive->cursor;
+	return archive->base + system_tell(archive->handle);
+}
+
+
+static void archive_seek(ZarHandle* archive, ZarOffset_t offset)
+{
+	if (archive->stream) {
+		error(EX_USAGE, "%s: can't seek to %lld in a stream.", archive->path, (long long)offset);
+	} else if (archive->mapping != NULL) {
+		if (offset < 0 || offset > archive->mapsize)
+			error(EX_DATAERR, "%s: seek to %lld is outside the archive.",
+			      archive->path, (long long)offset);
+		archive->cursor = offset;
+		return;
+	}
+
+	if (archive->nparts > 0) {
+		size_t k = find_part(archive, offset);
+		if (k != archive->part)
+			open_part(archive, k, "rb");
+	}
+	if (system_seek(archive->handle, offset - archive->base, SEEK_SET) != 0)
+		error(EX_IOERR, "%s: failed seeking to %lld: %s",
+		      archive->path, (long long)offset, strerror(errno));
+}
+
+
+/** Borrow the next n bytes from the mapping and advance past them.
+ *
+ * Returns NULL if the archive isn't mapped. Calls error() if there aren't n
+ * bytes left.
+ */
+static const unsigned char* archive_view(ZarHandle* archive, ZarOffset_t n)
+{
+	if (archive->mapping == NULL)
+		return NULL;
+	if (n < 0 || n > archive->mapsize - archive->cursor)
+		error(EX_DATAERR, "%s: unexpected end of archive.", archive->path);
+	const unsigned char* p = archive->mapping + archive->cursor;
+	archive->cursor += n;
+	return p;
+}
+
+
+static void archive_read(ZarHandle* archive, void* dest, size_t n)
+{
+	if (archive->mapping != NULL)
+		memcpy(dest, archive_view(archive, (ZarOffset_t)n), n);
+	else if (fread(dest, 1, n, archive->handle) != n)
+		error(EX_DATAERR, "%s: unexpected end of archive.", archive->path);
+	else if (archive->stream)
+		archive->cursor += n;
+}
+
+
+/** Like get_string() but reads from the archive. */
+static size_t archive_read_string(ZarHandle* archive, char* dest, size_t length)
+{
+	if (archive->mapping == NULL) {
+		size_t n = get_string(dest, length, archive->handle);
+		if (archive->stream)
+			archive->cursor += n;
+		return n;
+	}
+
+	const unsigned char* p = archive->mapping + archive->cursor;
+	size_t left = (size_t)(archive->mapsize - archive->cursor);
+	const unsigned char* nul = memchr(p, '\0', left < length ? left : length);
+	size_t n = nul == NULL ? (left < length ? left : length) : (size_t)(nul - p) + 1;
+
+	memset(dest, 0, length);
+	memcpy(dest, p, n);
+	if (nul == NULL)
+		dest[length - 1] = '\0';
+	archive->cursor += n;
+	return n;
+}
+
+
+/** Whether everything in the archive has been read. */
+static bool archive_at_end(ZarHandle* archive)
+{
+	if (archive->mapping != NULL)
+		return archive->cursor >= archive->mapsize;
+	int c = getc(archive->handle);
+	if (c == EOF) {
+		/* The next part of a split archive carries on from here. */
+		if (archive->part + 1 < archive->nparts) {
+			open_part(archive, archive->part + 1, "rb");
+			return archive_at_end(archive);
+		}
+		return true;
+	}
+	ungetc(c, archive->handle);
+	return false;
+}
+
+
+/** Where the next byte written to the archive will go. */
+static ZarOffset_t output_tell(ZarHandle* archive)
+{
+	if (archive->stream)
+		return archive->cursor;
+	return archive->base + system_tell(archive->handle);
+}
+
+
+/** Where encoded or extracted file data gets written.
+ *
+ * Either a stream that belongs to someone else, or a memory buffer. A memory
+ * buffer spills once it would grow past zar_tunables.spill_size, so a sink
+ * never holds more than that in RAM. It spills into the stream overflow hands
+ * back, or a temporary file if there's no overflow.
+ */
+typedef struct {
+	/* Used for error messages. */
+	const char* name;
+	FILE* file;
+	/* True when file is our own spill file. */
+	bool spilled;
+	unsigned char* data;
+	size_t length;
+	size_t capacity;
+	/* Bytes written so far, wherever they went. */
+	ZarOffset_t total;
+	/* If summing, the CRC-32 of those bytes. */
+	bool summing;
+	CRC32_t checksum;
+	/* Called once, with context, when the buffer would spill. */
+	FILE* (*overflow)(void* context);
+	void* context;
+} ZarSink;
+
+
+static void sink_open_file(ZarSink* sink, FILE* file, const char* name)
+{
+	memset(sink, 0, sizeof(*sink));
+	sink->name = name;
+	sink->file = file;
+}
+
+
+static void sink_open_memory(ZarSink* sink, const char* name)
+{
+	memset(sink, 0, sizeof(*sink));
+	sink->name = name;
+}
+
+
+static void sink_write(ZarSink* sink, const void* data, size_t n)
+{
+	if (sink->file == NULL && sink->length + n > zar_tunables.spill_size) {
+		if (sink->overflow != NULL) {
+			xtrace("%s: overflowing %zu buffered bytes", sink->name, sink->length);
+			sink->file = sink->overflow(sink->context);
+		} else {
+			xtrace("%s: spilling %zu buffered bytes to a temporary file", sink->name, sink->length);
+			sink->file = tmpfile();
+			if (sink->file == NULL)
+				error(EX_IOERR, "%s: unable to create temporary file: %s", sink->name, strerror(errno));
+			sink->spilled = true;
+		}
+		if (fwrite(sink->data, 1, sink->length, sink->file) != sink->length)
+			error(EX_IOERR, "%s: failed writing %zu buffered bytes: %s", sink->name, sink->length, strerror(errno));
+		free(sink->data);
+		sink->data = NULL;
+		sink->length = sink->capacity = 0;
+	}
+
+	if (sink->file != NULL) {
+		if (fwrite(data, 1, n, sink->file) != n)
+			error(EX_IOERR, "%s: failed writing %zu bytes: %s", sink->name, n, strerror(errno));
+	} else {
+		if (sink->length + n > sink->capacity) {
+			size_t capacity = sink->capacity ? sink->capacity : 4096;
+			while (capacity < sink->length + n)
+				capacity *= 2;
+			unsigned char* p = realloc(sink->data, capacity);
+			if (p == NULL)
+				error(EX_OSERR, "%s: unable to grow buffer to %zu bytes", sink->name, capacity);
+			sink->data = p;
+			sink->capacity = capacity;
+		}
+		memcpy(sink->data + sink->length, data, n);
+		sink->length += n;
+	}
+	sink->total += n;
+	if (sink->summing)
+		sink->checksum = crc_update(sink->checksum, data, n);
+}
+
+
+/** Forget what's been written to a memory sink, which must not have spilled. */
+static void sink_reset(ZarSink* sink)
+{
+	sink->length = 0;
+	sink->total = 0;
+	sink->checksum = 0;
+}
+
+
+/** Release anything the sink owns. A stream that isn't ours is left open. */
+static void sink_close(ZarSink* sink)
+{
+	if (sink->spilled)
+		fclose(sink->file);
+	free(sink->data);
+	memset(sink, 0, sizeof(*sink));
+}
+
+
+/** Log how fast nbytes went by in the given number of seconds. */
+static void report_throughput(const char* what, ZarOffset_t nbytes, double seconds)
+{
+	double mib = (double)nbytes / (1024.0 * 1024.0);
+	if (seconds <= 0.0)
+		seconds = 1e-9;
+	info("%s: %lld bytes in %.3f seconds (%.1f MiB/s)",
+	     what, (long long)nbytes, seconds, mib / seconds);
+}
+
+
+/** Copy file data from a stream to a sink a block at a time.
+ *
+ * Copies length bytes from in to out, or everything up to EOF if length is
+ * negative. Blocks are zar_tunables.block_size bytes. When checksum is not
+ * NULL it is updated with the CRC-32 of every byte copied. When out is NULL
+ * the data is only read, which is handy for checksumming.
+ *
+ * The name is only used for error messages. Any read or write failure, and
+ * an early EOF when length is known, calls error().
+ *
+ * Returns the number of bytes copied.
+ */
+static ZarOffset_t copy_blocks(FILE* in, const char* inname, ZarSink* out,
+                               ZarOffset_t length, CRC32_t* checksum)
+{
+	size_t size = zar_tunables.block_size;
+	unsigned char* block = malloc(size);
+	if (block == NULL)
+		error(EX_OSERR, "unable to allocate %zu byte copy buffer", size);
+
+	double start = system_clock();
+	ZarOffset_t total = 0;
+	while (length < 0 || total < length) {
+		size_t want = size;
+		if (length >= 0 && (ZarOffset_t)want > length - total)
+			want = (size_t)(length - total);
+
+		size_t got = fread(block, 1, want, in);
+		if (got == 0) {
+			if (ferror(in))
+				error(EX_IOERR, "%s: read failed: %s", inname, strerror(errno));
+			if (length >= 0)
+				error(EX_IOERR, "%s: unexpected EOF after %lld of %lld bytes.",
+				      inname, (long long)total, (long long)length);
+			break;
+		}
+
+		if (checksum != NULL)
+			*checksum = crc_update(*checksum, block, got);
+		if (out != NULL)
+			sink_write(out, block, got);
+		total += got;
+	}
+	free(block);
+
+	xtrace("copied %lld bytes from %s to %s", (long long)total, inname, out ? out->name : "nowhere");
+	if (debug_level >= DEBUG_debug)
+		report_throughput(inname, total, system_clock() - start);
+
+	return total;
+}
+
+
+/** Copy length bytes of in starting at offset onto the end of a file sink.
+ *
+ * Done in the kernel where possible, with stdio picking up whatever it
+ * won't do.
+ */
+static void copy_file_range_to(FILE* in, const char* inname, ZarOffset_t offset,
+                               ZarSink* out, ZarOffset_t length)
+{
+	double start = system_clock();
+	ZarOffset_t done = system_copy_range(in, offset, out->file, length);
+	out->total += done;
+	xtrace("%s: copied %lld of %lld bytes in the kernel", inname, (long long)done, (long long)length);
+	if (done < length)
+		copy_blocks(in, inname, out, length - done, NULL);
+	if (debug_level >= DEBUG_debug)
+		report_throughput(inname, length, system_clock() - start);
+}
+
+
+/** Read past the next n bytes of the archive, adding them to checksum if it isn't NULL.
+ *
+ * Unlike archive_seek() this works on a stream.
+ */
+static void archive_skip(ZarHandle* archive, ZarOffset_t n, CRC32_t* checksum)
+{
+	const unsigned char* data = archive_view(archive, n);
+	if (data != NULL) {
+		if (checksum != NULL)
+			*checksum = crc_update(*checksum, data, (size_t)n);
+		return;
+	}
+	copy_blocks(archive->handle, archive->path, NULL, n, checksum);
+	if (archive->stream)
+		archive->cursor += n;
+}
+
+
+/** Size of the whole archive. It mustn't be a stream. */
+static ZarOffset_t archive_size(ZarHandle* archive)
+{
+	if (archive->mapping != NULL)
+		return archive->mapsize;
+	if (archive->nparts > 0)
+		return archive->partstarts[archive->nparts];
+
+	ZarOffset_t here = archive_tell(archive);
+	if (system_seek(archive->handle, 0, SEEK_END) != 0)
+		error(EX_IOERR, "%s: failed seeking to end of archive: %s", archive->path, strerror(errno));
+	ZarOffset_t size = system_tell(archive->handle);
+	archive_seek(archive, here);
+	return size;
+}
+
+
+/** Store raw file data in archive.
+ *
+ * Call this to copy the file into the sink without any mutations.
+ * Updates the record's checksum field with the inputs CRC-32.
+ * Returns the length of the data in bytes.
+ */
+static ZarOffset_t record_raw_file(ZarFileRecord* record, FILE* infile, ZarSink* out)
+{
+	xtrace("%s: recording raw file to %s.", record->path, out->name);
+
+	record->checksum = 0;
+	ZarOffset_t length;
+	if (out->file != NULL && !out->spilled && system_has_copy_range()) {
+		/* Checksum it, then let the kernel move the data. */
+		length = copy_blocks(infile, record->path, NULL, -1, &record->checksum);
+		copy_file_range_to(infile, record->path, 0, out, length);
+	} else {
+		length = copy_blocks(infile, record->path, out, -1, &record->checksum);
+	}
+	debug("%s: file checksum: %lu", record->path, (unsigned long)record->checksum);
+	debug("%s: file length: %lld", record->path, (long long)length);
+
+	return length;
+}
+
+
+/** Extract raw file data from archive.
+ *
+ * Current position into the archive must be at the start of the file data.
+ * Upon exit it is just past the data, where the stored checksum begins.
+ * Returns the CRC-32 of the extracted data, or 0 if --no-verify said not to
+ * bother.
+ */
+static CRC32_t extract_raw_file(ZarFileRecord* record, ZarHandle* archive)
+{
+	debug("length: %lld", (long long)record->length);
+
+	FILE* outfile = fopen(record->path, "wb");
+	if (outfile == NULL)
+		error(EX_IOERR, "failed creating %s: %s", record->path, strerror(errno));
+
+	ZarSink sink;
+	sink_open_file(&sink, outfile, record->path);
+	CRC32_t outsum = 0;
+	CRC32_t* checksum = zar_tunables.verify ? &outsum : NULL;
+	ZarOffset_t start = archive_tell(archive);
+	const unsigned char* data = archive_view(archive, record->length);
+
+	if (system_has_copy_range() && !archive->stream) {
+		/*
+		 * The bytes in the archive are the file: checksum them where they lie
+		 * in a pass of their own, then have the kernel copy them over.
+		 */
+		if (checksum != NULL) {
+			if (data != NULL)
+				outsum = crc_update(outsum, data, (size_t)record->length);
+			else
+				copy_blocks(archive->handle, archive->path, NULL, record->length, checksum);
+		}
+		copy_file_range_to(archive->handle, archive->path, start - archive->base, &sink, record->length);
+	} else if (data != NULL) {
+		/* Straight out of the mapping, a block at a time while it's in cache. */
+		for (ZarOffset_t done = 0; done < record->length; ) {
+			size_t n = zar_tunables.block_size;
+			if ((ZarOffset_t)n > record->length - done)
+				n = (size_t)(record->length - done);
+			if (checksum != NULL)
+				outsum = crc_update(outsum, data + done, n);
+			sink_write(&sink, data + done, n);
+			done += n;
+		}
+	} else {
+		copy_blocks(archive->handle, archive->path, &sink, record->length, checksum);
+		if (archive->stream)
+			archive->cursor += record->length;
+	}
+	sink_close(&sink);
+
+	if (fclose(outfile) != 0)
+		error(EX_IOERR, "failed writing %s: %s", record->path, strerror(errno));
+
+	return checksum != NULL ? outsum : 0;
+}
+
+
+/* Bytes a codec has output, and where they go. */
+struct CodecOutput {
+	ZarSink* sink;
+	ZarOffset_t length;
+};
+
+
+static void write_codec_output(void* context, const void* data, size_t n)
+{
+	struct CodecOutput* out = context;
+	sink_write(out->sink, data, n);
+	out->length += n;
+}
+
+
+/** Store file data in archive encoded with codec.
+ *
+ * The input is compressed a block at a time at zar_tunables.level, so memory
+ * use doesn't depend on the size of the file. Updates the record's checksum
+ * field with the CRC-32 of the uncompressed input.
+ * Returns the length of the compressed data in bytes, or -1 if the data
+ * wasn't shrinking and out is a memory sink the caller can start over on.
+ */
+static ZarOffset_t record_codec_file(ZarFileRecord* record, const ZarCodec* codec,
+                                     FILE* infile, ZarSink* out)
+{
+	xtrace("%s: compressing file with %s to %s.", record->path, codec->name, out->name);
+
+	size_t size = zar_tunables.block_size;
+	unsigned char* in = malloc(size);
+	if (in == NULL)
+		error(EX_OSERR, "unable to allocate %zu byte %s buffer", size, codec->name);
+	void* state = codec->init(true, zar_tunables.level, record->path);
+
+	double start = system_clock();
+	ZarOffset_t inlength = 0;
+	struct CodecOutput output = { out, 0 };
+	bool last;
+	record->checksum = 0;
+	do {
+		size_t got = fread(in, 1, size, infile);
+		if (ferror(infile))
+			error(EX_IOERR, "%s: read failed: %s", record->path, strerror(errno));
+		last = feof(infile);
+		record->checksum = crc_update(record->checksum, in, got);
+		inlength += got;
+		codec->compress_block(state, in, got, last, write_codec_output, &output);
+
+		/*
+		 * Not saving even a thirty-second? While the output is still in memory
+		 * it can be thrown away and the file stored as it is instead.
+		 */
+		if (out->file == NULL && output.length >= inlength - inlength / 32) {
+			debug("%s: compressed %lld bytes to %lld, giving up", record->path,
+			      (long long)inlength, (long long)output.length);
+			output.length = -1;
+			break;
+		}
+	} while (!last);
+
+	codec->finish(state);
+	free(in);
+
+	debug("%s: file checksum: %lu", record->path, (unsigned long)record->checksum);
+	debug("%s: %s compressed %lld bytes to %lld", record->path, codec->name,
+	      (long long)inlength, (long long)output.length);
+	if (debug_level >= DEBUG_debug)
+		report_throughput(record->path, inlength, system_clock() - start);
+
+	return output.length;
+}
+
+
+/* One chunk of input and the deflated output for it. */
+struct DeflateChunk {
+	unsigned char* in;
+	size_t inlength;
+	/* Tail of the previous chunk, used as a preset dictionary. */
+	unsigned char dictionary[ZAR_DEFLATE_WINDOW];
+	size_t dictlength;
+	unsigned char* out;
+	size_t outlength;
+	size_t outcapacity;
+	CRC32_t checksum;
+};
+
+
+/* Shared between record_deflate_chunked() and its workers. */
+struct DeflateChunkJobs {
+	ZarFileRecord* record;
+	FILE* infile;
+	size_t nchunks;
+	/* One slot per job in the pool's window, indexed by job % nslots. */
+	struct DeflateChunk* slots;
+	size_t nslots;
+
+	/* Chunks are read in order by whichever worker got them. */
+	void* mutex;
+	void* cond;
+	size_t nextread;
+	unsigned char tail[ZAR_DEFLATE_WINDOW];
+	size_t taillength;
+};
+
+
+static void deflate_chunk_job(void* context, size_t index)
+{
+	struct DeflateChunkJobs* jobs = context;
+	struct DeflateChunk* chunk = &jobs->slots[index % jobs->nslots];
+	size_t size = zar_tunables.chunk_size;
+
+	system_mutex_lock(jobs->mutex);
+	while (jobs->nextread != index)
+		system_cond_wait(jobs->cond, jobs->mutex);
+
+	chunk->inlength = fread(chunk->in, 1, size, jobs->infile);
+	if (ferror(jobs->infile))
+		error(EX_IOERR, "%s: read failed: %s", jobs->record->path, strerror(errno));
+
+	memcpy(chunk->dictionary, jobs->tail, jobs->taillength);
+	chunk->dictlength = jobs->taillength;
+
+	/* Slide the window along for the next chunk. */
+	if (chunk->inlength >= ZAR_DEFLATE_WINDOW) {
+		memcpy(jobs->tail, chunk->in + chunk->inlength - ZAR_DEFLATE_WINDOW, ZAR_DEFLATE_WINDOW);
+		jobs->taillength = ZAR_DEFLATE_WINDOW;
+	} else {
+		size_t keep = ZAR_DEFLATE_WINDOW - chunk->inlength;
+		if (keep > jobs->taillength)
+			keep = jobs->taillength;
+		memmove(jobs->tail, jobs->tail + jobs->taillength - keep, keep);
+		memcpy(jobs->tail + keep, chunk->in, chunk->inlength);
+		jobs->taillength = keep + chunk->inlength;
+	}
+
+	jobs->nextread++;
+	system_cond_broadcast(jobs->cond);
+	system_mutex_unlock(jobs->mutex);
+
+	chunk->checksum = crc_update(0, chunk->in, chunk->inlength);
+
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	if (deflateInit2(&z, zar_tunables.level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		error(EX_SOFTWARE, "%s: deflateInit2() failed: %s", jobs->record->path, z.msg);
+	if (chunk->dictlength > 0
+	    && deflateSetDictionary(&z, chunk->dictionary, (uInt)chunk->dictlength) != Z_OK)
+		error(EX_SOFTWARE, "%s: deflateSetDictionary() failed: %s", jobs->record->path, z.msg);
+
+	/* Room for the worst case plus the empty stored block a sync flush adds. */
+	size_t bound = deflateBound(&z, (uLong)chunk->inlength) + 16;
+	if (chunk->outcapacity < bound) {
+		free(chunk->out);
+		chunk->out = malloc(bound);
+		if (chunk->out == NULL)
+			error(EX_OSERR, "unable to allocate %zu byte deflate buffer", bound);
+		chunk->outcapacity = bound;
+	}
+
+	/*
+	 * Every chunk but the last ends on a byte boundary without setting the
+	 * final block bit, so the outputs can simply be concatenated.
+	 */
+	bool last = index + 1 == jobs->nchunks;
+	z.next_in = chunk->in;
+	z.avail_in = (uInt)chunk->inlength;
+	z.next_out = chunk->out;
+	z.avail_out = (uInt)chunk->outcapacity;
+	int status = deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH);
+	if (last ? status != Z_STREAM_END : (status != Z_OK || z.avail_in != 0 || z.avail_out == 0))
+		error(EX_SOFTWARE, "%s: deflate() failed on chunk %zu: %s",
+		      jobs->record->path, index, z.msg ? z.msg : "output buffer too small");
+	chunk->outlength = chunk->outcapacity - z.avail_out;
+	deflateEnd(&z);
+}
+
+
+/** Store a big file in archive as a raw deflate stream, compressed in parallel.
+ *
+ * The file is cut into zar_tunables.chunk_size chunks that are deflated on
+ * zar_tunables.jobs threads, each primed with the tail of the chunk before it,
+ * pigz style. The pieces are stitched back together into one stream that
+ * extract_codec_file() can't tell apart from any other. The output depends
+ * on the chunk size but not on the number of threads.
+ *
+ * Updates the record's checksum field with the CRC-32 of the uncompressed
+ * input. Returns the length of the compressed data in bytes.
+ */
+static ZarOffset_t record_deflate_chunked(ZarFileRecord* record, FILE* infile,
+                                          ZarOffset_t size, ZarSink* out)
+{
+	xtrace("%s: deflating file in chunks to %s.", record->path, out->name);
+
+	struct DeflateChunkJobs jobs;
+	memset(&jobs, 0, sizeof(jobs));
+	jobs.record = record;
+	jobs.infile = infile;
+	jobs.nchunks = (size_t)((size + zar_tunables.chunk_size - 1) / zar_tunables.chunk_size);
+	if (jobs.nchunks == 0)
+		jobs.nchunks = 1;
+	jobs.nslots = 2 * zar_tunables.jobs;
+	jobs.slots = calloc(jobs.nslots, sizeof(struct DeflateChunk));
+	if (jobs.slots == NULL)
+		error(EX_OSERR, "unable to allocate %zu deflate chunks", jobs.nslots);
+	for (size_t i=0; i < jobs.nslots; ++i) {
+		jobs.slots[i].in = malloc(zar_tunables.chunk_size);
+		if (jobs.slots[i].in == NULL)
+			error(EX_OSERR, "unable to allocate %zu byte chunk", zar_tunables.chunk_size);
+	}
+	jobs.mutex = system_mutex_create();
+	jobs.cond = system_cond_create();
+
+	double start = system_clock();
+	ZarOffset_t inlength = 0;
+	ZarOffset_t length = 0;
+	record->checksum = 0;
+
+	ZarPool* pool = pool_start(zar_tunables.jobs, jobs.nchunks, jobs.nslots,
+	                           deflate_chunk_job, &jobs);
+	for (size_t i=0; i < jobs.nchunks; ++i) {
+		struct DeflateChunk* chunk = &jobs.slots[i % jobs.nslots];
+		pool_wait(pool, i);
+		sink_write(out, chunk->out, chunk->outlength);
+		record->checksum = crc_combine(record->checksum, chunk->checksum, chunk->inlength);
+		inlength += chunk->inlength;
+		length += chunk->outlength;
+		pool_release(pool, i);
+	}
+	pool_finish(pool);
+
+	system_cond_destroy(jobs.cond);
+	system_mutex_destroy(jobs.mutex);
+	for (size_t i=0; i < jobs.nslots; ++i) {
+		free(jobs.slots[i].in);
+		free(jobs.slots[i].out);
+	}
+	free(jobs.slots);
+
+	debug("%s: file checksum: %lu", record->path, (unsigned long)record->checksum);
+	debug("%s: deflated %lld bytes to %lld in %zu chunks",
+	      record->path, (long long)inlength, (long long)length, jobs.nchunks);
+	if (debug_level >= DEBUG_debug)
+		report_throughput(record->path, inlength, system_clock() - start);
+
+	return length;
+}
+
+
+/* Where extracted data goes, and the CRC-32 of it so far. */
+struct ExtractOutput {
+	FILE* file;
+	const char* path;
+	CRC32_t checksum;
+};
+
+
+static void write_extracted(void* context, const void* data, size_t n)
+{
+	struct ExtractOutput* out = context;
+	out->checksum = crc_update(out->checksum, data, n);
+	if (fwrite(data, 1, n, out->file) != n)
+		error(EX_IOERR, "failed writing %s: %s", out->path, strerror(errno));
+}
+
+
+/** Extract file data encoded with codec from archive.
+ *
+ * Current position into the archive must be at the start of the file data.
+ * Upon exit it is just past the data, where the stored checksum begins.
+ * Returns the CRC-32 of the decoded data.
+ */
+static CRC32_t extract_codec_file(ZarFileRecord* record, const ZarCodec* codec, ZarHandle* archive)
+{
+	debug("length: %lld", (long long)record->length);
+
+	struct ExtractOutput out = { fopen(record->path, "wb"), record->path, 0 };
+	if (out.file == NULL)
+		error(EX_IOERR, "failed creating %s: %s", record->path, strerror(errno));
+
+	size_t size = zar_tunables.block_size;
+	unsigned char* in = malloc(size);
+	if (in == NULL)
+		error(EX_OSERR, "unable to allocate %zu byte %s buffer", size, codec->name);
+	void* state = codec->init(false, zar_tunables.level, record->path);
+
+	/* At least once, for a stream of nothing. */
+	ZarOffset_t remaining = record->length;
+	bool ended;
+	do {
+		size_t want = (ZarOffset_t)size > remaining ? (size_t)remaining : size;
+		const unsigned char* data = archive_view(archive, (ZarOffset_t)want);
+		if (data == NULL) {
+			archive_read(archive, in, want);
+			data = in;
+		}
+		remaining -= want;
+
+		size_t used;
+		ended = codec->decompress_block(state, data, want, &used, write_extracted, &out);
+		if (ended && (used != want || remaining != 0))
+			error(EX_DATAERR, "%s: trailing garbage after %s stream for %s.",
+			      archive->path, codec->name, record->path);
+	} while (remaining > 0);
+	if (!ended)
+		error(EX_DATAERR, "%s: %s stream for %s is truncated.",
+		      archive->path, codec->name, record->path);
+
+	codec->finish(state);
+	free(in);
+	if (fclose(out.file) != 0)
+		error(EX_IOERR, "failed writing %s: %s", record->path, strerror(errno));
+
+	return out.checksum;
+}
+
+
+/** Store file data as content-defined chunks, each distinct one once per volume.
+ *
+ * The data is a run of entries, a chunk apiece, in order:
+ *
+ *   - A chunk stored here: its length, the length stored, then the chunk,
+ *     deflated at zar_tunables.level if that made it smaller.
+ *   - A chunk stored before: minus its length, then where its entry is in
+ *     the archive.
+ *
+ * archive->chunks says which chunks are in the volume already, and learns the
+ * new ones. The record must be the next thing written to archive, so where
+ * they'll land is known. Updates the record's checksum field with the CRC-32
+ * of the input. Returns the length of the data in bytes.
+ */
+static ZarOffset_t record_dedup_file(ZarFileRecord* record, FILE* infile, ZarSink* out, ZarHandle* archive)
+{
+	xtrace("%s: chunking file to %s.", record->path, out->name);
+
+	ZarOffset_t base = output_tell(archive) + record_header_size(record->path);
+
+	/* Whenever there's input left, keep at least a whole chunk of it buffered. */
+	size_t size = zar_tunables.block_size > 2 * CHUNK_MAX ? zar_tunables.block_size : 2 * CHUNK_MAX;
+	unsigned char* in = malloc(size);
+	if (in == NULL)
+		error(EX_OSERR, "unable to allocate %zu byte chunking buffer", size);
+
+	bool deflating = compressing();
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	if (deflating && deflateInit2(&z, zar_tunables.level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		error(EX_SOFTWARE, "%s: deflateInit2() failed: %s", record->path, z.msg);
+	size_t bound = deflating ? deflateBound(&z, CHUNK_MAX) : 0;
+	unsigned char* packed = deflating ? malloc(bound) : NULL;
+	if (deflating && packed == NULL)
+		error(EX_OSERR, "unable to allocate %zu byte deflate buffer", bound);
+
+	double start = system_clock();
+	ZarOffset_t inlength = 0;
+	ZarOffset_t length = 0;
+	size_t nchunks = 0, nshared = 0;
+	size_t pos = 0, end = 0;
+	bool eof = false;
+	record->checksum = 0;
+	for (;;) {
+		if (!eof && end - pos < CHUNK_MAX) {
+			memmove(in, in + pos, end - pos);
+			end -= pos;
+			pos = 0;
+			end += fread(in + end, 1, size - end, infile);
+			if (ferror(infile))
+				error(EX_IOERR, "%s: read failed: %s", record->path, strerror(errno));
+			eof = feof(infile);
+		}
+		if (pos == end)
+			break;
+
+		const unsigned char* chunk = in + pos;
+		size_t n = chunk_cut(chunk, end - pos);
+		pos += n;
+		inlength += n;
+		nchunks++;
+
+		CRC32_t crc = crc_update(0, chunk, n);
+		record->checksum = crc_update(record->checksum, chunk, n);
+		uint64_t hash = chunk_hash(chunk, n);
+
+		ZarOffset_t entry[2];
+		ZarOffset_t at = chunk_index_find(archive->chunks, hash, crc, n);
+		if (at >= 0) {
+			entry[0] = -(ZarOffset_t)n;
+			entry[1] = at;
+			sink_write(out, entry, sizeof(entry));
+			length += sizeof(entry);
+			nshared++;
+			continue;
+		}
+		chunk_index_add(archive->chunks, hash, crc, n, base + length);
+
+		const unsigned char* stored = chunk;
+		size_t nstored = n;
+		if (deflating) {
+			deflateReset(&z);
+			z.next_in = (Bytef*)chunk;
+			z.avail_in = (uInt)n;
+			z.next_out = packed;
+			z.avail_out = (uInt)bound;
+			if (deflate(&z, Z_FINISH) != Z_STREAM_END)
+				error(EX_SOFTWARE, "%s: deflate() failed: %s", record->path, z.msg);
+			if (bound - z.avail_out < n) {
+				stored = packed;
+				nstored = bound - z.avail_out;
+			}
+		}
+		entry[0] = (ZarOffset_t)n;
+		entry[1] = (ZarOffset_t)nstored;
+		sink_write(out, entry, sizeof(entry));
+		sink_write(out, stored, nstored);
+		length += (ZarOffset_t)(sizeof(entry) + nstored);
+	}
+
+	if (deflating)
+		deflateEnd(&z);
+	free(packed);
+	free(in);
+
+	debug("%s: file checksum: %lu", record->path, (unsigned long)record->checksum);
+	debug("%s: %lld bytes in %zu chunks, %zu of them stored before, stored in %lld",
+	      record->path, (long long)inlength, nchunks, nshared, (long long)length);
+	if (debug_level >= DEBUG_debug)
+		report_throughput(record->path, inlength, system_clock() - start);
+
+	return length;
+}
+
+
+/** Extract file data stored by record_dedup_file().
+ *
+ * A chunk stored before is read from its entry, and then the archive goes
+ * back to where it was, which a stream can't. The position into the archive
+ * must be at the start of the file data. Upon exit it is just past the data,
+ * where the stored checksum begins. Returns the CRC-32 of the extracted data.
+ */
+static CRC32_t extract_dedup_file(ZarFileRecord* record, ZarHandle* archive)
+{
+	debug("length: %lld", (long long)record->length);
+
+	FILE* outfile = fopen(record->path, "wb");
+	if (outfile == NULL)
+		error(EX_IOERR, "failed creating %s: %s", record->path, strerror(errno));
+
+	unsigned char* packed = malloc(CHUNK_MAX);
+	unsigned char* chunk = malloc(CHUNK_MAX);
+	if (packed == NULL || chunk == NULL)
+		error(EX_OSERR, "unable to allocate %d byte chunk buffers", CHUNK_MAX);
+
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	if (inflateInit2(&z, -MAX_WBITS) != Z_OK)
+		error(EX_SOFTWARE, "%s: inflateInit2() failed: %s", record->path, z.msg);
+
+	CRC32_t outsum = 0;
+	ZarOffset_t remaining = record->length;
+	while (remaining > 0) {
+		ZarOffset_t entry[2];
+		if (remaining < (ZarOffset_t)sizeof(entry))
+			error(EX_DATAERR, "%s: chunks of %s are truncated.", archive->path, record->path);
+		archive_read(archive, entry, sizeof(entry));
+		remaining -= sizeof(entry);
+
+		/* Go and get a chunk stored before, then come back. */
+		ZarOffset_t back = -1;
+		if (entry[0] < 0) {
+			if (archive->stream)
+				error(EX_USAGE, "%s: %s shares chunks with earlier records, which a stream can't go back to.",
+				      archive->path, record->path);
+			ZarOffset_t n = -entry[0];
+			back = archive_tell(archive);
+			archive_seek(archive, entry[1]);
+			archive_read(archive, entry, sizeof(entry));
+			if (entry[0] != n)
+				error(EX_DATAERR, "%s: bad chunk reference in %s.", archive->path, record->path);
+		} else if (entry[1] > remaining) {
+			error(EX_DATAERR, "%s: chunks of %s are truncated.", archive->path, record->path);
+		} else {
+			remaining -= entry[1];
+		}
+		if (entry[0] <= 0 || entry[0] > CHUNK_MAX || entry[1] <= 0 || entry[1] > entry[0])
+			error(EX_DATAERR, "%s: corrupt chunk in %s.", archive->path, record->path);
+
+		size_t n = (size_t)entry[0];
+		size_t nstored = (size_t)entry[1];
+		const unsigned char* data = archive_view(archive, (ZarOffset_t)nstored);
+		if (data == NULL) {
+			archive_read(archive, packed, nstored);
+			data = packed;
+		}
+		if (nstored < n) {
+			inflateReset(&z);
+			z.next_in = (Bytef*)data;
+			z.avail_in = (uInt)nstored;
+			z.next_out = chunk;
+			z.avail_out = (uInt)n;
+			if (inflate(&z, Z_FINISH) != Z_STREAM_END || z.avail_out != 0)
+				error(EX_DATAERR, "%s: failed inflating a chunk of %s: %s",
+				      archive->path, record->path, z.msg ? z.msg : "corrupt data");
+			data = chunk;
+		}
+		outsum = crc_update(outsum, data, n);
+		if (fwrite(data, 1, n, outfile) != n)
+			error(EX_IOERR, "failed writing %s: %s", record->path, strerror(errno));
+
+		if (back >= 0)
+			archive_seek(archive, back);
+	}
+
+	inflateEnd(&z);
+	free(packed);
+	free(chunk);
+	if (fclose(outfile) != 0)
+		error(EX_IOERR, "failed writing %s: %s", record->path, strerror(errno));
+
+	return outsum;
+}
+
+
+/*
+ * Solid blocks.
+ *
+ * Small files are deflated together, a block at a time, as one stream. Each
+ * still has a record of its own, whose data starts with these fields. The
+ * first record of the block, which leads it, follows them with the size of
+ * the whole block inflated and then the stream itself.
+ */
+struct SolidFields {
+	/* Where the leading record starts, or 0 in the leading record itself. */
+	ZarOffset_t block;
+	/* Where the file's data starts in the inflated block. */
+	ZarOffset_t position;
+	ZarOffset_t size;
+};
+
+
+/** Inflate the block led by the record at leader into archive->block.
+ *
+ * The archive must be just past the leading record's fields, with length
+ * bytes of its data left. Upon exit it is just past the data.
+ */
+static void load_solid_block(ZarHandle* archive, ZarOffset_t leader, ZarOffset_t length)
+{
+	ZarOffset_t total;
+	archive_read(archive, &total, sizeof(total));
+	length -= sizeof(total);
+	if (total < 0 || length < 0)
+		error(EX_DATAERR, "%s: corrupt solid block at %lld.", archive->path, (long long)leader);
+	debug("%s: inflating solid block at %lld, %lld bytes to %lld",
+	      archive->path, (long long)leader, (long long)length, (long long)total);
+
+	free(archive->block);
+	archive->block = malloc(total > 0 ? (size_t)total : 1);
+	archive->blockstart = -1;
+	size_t size = zar_tunables.block_size;
+	unsigned char* in = malloc(size);
+	if (archive->block == NULL || in == NULL)
+		error(EX_OSERR, "unable to allocate %lld bytes for a solid block", (long long)total);
+
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	if (inflateInit2(&z, -MAX_WBITS) != Z_OK)
+		error(EX_SOFTWARE, "%s: inflateInit2() failed: %s", archive->path, z.msg);
+	z.next_out = archive->block;
+	z.avail_out = (uInt)total;
+	int status = Z_OK;
+	while (status != Z_STREAM_END) {
+		if (z.avail_in == 0) {
+			if (length == 0)
+				error(EX_DATAERR, "%s: solid block at %lld is truncated.", archive->path, (long long)leader);
+			size_t want = (ZarOffset_t)size > length ? (size_t)length : size;
+			const unsigned char* view = archive_view(archive, (ZarOffset_t)want);
+			if (view != NULL) {
+				z.next_in = (Bytef*)view;
+			} else {
+				archive_read(archive, in, want);
+				z.next_in = in;
+			}
+			length -= want;
+			z.avail_in = (uInt)want;
+		}
+		status = inflate(&z, Z_NO_FLUSH);
+		if (status != Z_OK && status != Z_STREAM_END)
+			error(EX_DATAERR, "%s: failed inflating solid block at %lld: %s",
+			      archive->path, (long long)leader, z.msg ? z.msg : "corrupt data");
+	}
+	if (length != 0 || z.avail_in != 0 || z.avail_out != 0)
+		error(EX_DATAERR, "%s: solid block at %lld is the wrong size.", archive->path, (long long)leader);
+
+	inflateEnd(&z);
+	free(in);
+	archive->blockstart = leader;
+	archive->blocksize = total;
+}
+
+
+/** Read the fields of the leading record at leader and inflate its block.
+ *
+ * The archive is left where it was, so this can't be done on a stream.
+ */
+static void fetch_solid_block(ZarHandle* archive, ZarOffset_t leader)
+{
+	if (archive->stream)
+		error(EX_USAGE, "%s: the solid block at %lld has gone by in the stream.",
+		      archive->path, (long long)leader);
+	ZarOffset_t back = archive_tell(archive);
+	archive_seek(archive, leader);
+
+	/* Not into recordpath: that's the path of the record being extracted. */
+	ZarOffset_t offset, length;
+	char path[ZAR_MAX_PATH];
+	char format[2];
+	struct SolidFields fields;
+	archive_read(archive, &offset, sizeof(offset));
+	archive_read_string(archive, path, sizeof(path));
+	archive_read(archive, format, sizeof(format));
+	archive_read(archive, &length, sizeof(length));
+	archive_read(archive, &fields, sizeof(fields));
+	if (format[0] != zar_format_solid[0] || format[1] != zar_format_solid[1] || fields.block != 0)
+		error(EX_DATAERR, "%s: no solid block at %lld.", archive->path, (long long)leader);
+	load_solid_block(archive, leader, length - (ZarOffset_t)sizeof(fields));
+
+	archive_seek(archive, back);
+}
+
+
+/** Extract file data stored in a solid block.
+ *
+ * The block is kept inflated in archive->block, so the records after it get
+ * their data from there. The position into the archive must be at the start
+ * of the file data. Upon exit it is just past the data, where the stored
+ * checksum begins. Returns the CRC-32 of the extracted data.
+ */
+static CRC32_t extract_solid_file(ZarFileRecord* record, ZarHandle* archive)
+{
+	struct SolidFields fields;
+	if (record->length < (ZarOffset_t)sizeof(fields))
+		error(EX_DATAERR, "%s: solid record of %s is truncated.", archive->path, record->path);
+	ZarOffset_t start = archive_tell(archive) - record_header_size(record->path);
+	archive_read(archive, &fields, sizeof(fields));
+	ZarOffset_t rest = record->length - (ZarOffset_t)sizeof(fields);
+
+	if (fields.block == 0) {
+		load_solid_block(archive, start, rest);
+	} else {
+		if (archive->block == NULL || archive->blockstart != fields.block)
+			fetch_solid_block(archive, fields.block);
+		archive_skip(archive, rest, NULL);
+	}
+	if (fields.position < 0 || fields.size < 0 || fields.position + fields.size > archive->blocksize)
+		error(EX_DATAERR, "%s: %s is outside its solid block.", archive->path, record->path);
+
+	FILE* outfile = fopen(record->path, "wb");
+	if (outfile == NULL)
+		error(EX_IOERR, "failed creating %s: %s", record->path, strerror(errno));
+	const unsigned char* data = archive->block + fields.position;
+	size_t n = (size_t)fields.size;
+	if (fwrite(data, 1, n, outfile) != n)
+		error(EX_IOERR, "failed writing %s: %s", record->path, strerror(errno));
+	if (fclose(outfile) != 0)
+		error(EX_IOERR, "failed writing %s: %s", record->path, strerror(errno));
+
+	return crc_update(0, data, n);
+}
+
+
+/** Like read_file_record_header(), for a record whose offset has been read. */
+static void read_file_record_fields(ZarFileRecord* record, ZarHandle* archive)
+{
+	xtrace("pos at read path: %lld", (long long)archive_tell(archive));
+	/* We're limiting paths to ZAR_MAX_PATH but the format uses NUL termination. */
+	archive_read_string(archive, archive->recordpath, sizeof(archive->recordpath));
+	record->path = archive->recordpath;
+	debug("read file record path: %s", record->path);
+	if (strlen(record->path) == 0)
+		error(EX_SOFTWARE, "Mysteriously didn't read a string here. %s:%d", __FILE__, __LINE__);
+
+	xtrace("pos at read format: %lld", (long long)archive_tell(archive));
+	archive_read(archive, record->format, sizeof(record->format));
+	debug("file data format is %c%c", record->format[0], record->format[1]);
+
+	xtrace("pos at read length: %lld", (long long)archive_tell(archive));
+	archive_read(archive, &record->length, sizeof(ZarOffset_t));
+	debug("file data is %lld bytes long", (long long)record->length);
+}
+
+
+/** Read the fields of a file record that precede its data.
+ *
+ * Current position into the archive must be aligned to the start of a record.
+ * Upon exit it is aligned to the start of the record's file data.
+ */
+static void read_file_record_header(ZarFileRecord* record, ZarHandle* archive)
+{
+	xtrace("pos at read offset: %lld", (long long)archive_tell(archive));
+	archive_read(archive, &record->offset, sizeof(ZarOffset_t));
+	debug("offset to end of record: %lld bytes", (long long)record->offset);
+	read_file_record_fields(record, archive);
+}
+
+
+/** Extract the data of a record whose header has just been read, and check it. */
+static void extract_file_data(ZarFileRecord* record, ZarHandle* archive)
+{
+	const ZarCodec* codec = codec_find(record->format);
+	if (codec == NULL && !is_format(record, zar_format_dedup) && !is_format(record, zar_format_solid))
+		error(EX_DATAERR, "%s: unsupported format: %c%c",
+		      archive->path, record->format[0], record->format[1]);
+
+	/* Raw data has a faster way out than through its codec. */
+	CRC32_t outsum;
+	if (is_format(record, zar_format_dedup))
+		outsum = extract_dedup_file(record, archive);
+	else if (is_format(record, zar_format_solid))
+		outsum = extract_solid_file(record, archive);
+	else if (is_format(record, zar_format_raw))
+		outsum = extract_raw_file(record, archive);
+	else
+		outsum = extract_codec_file(record, codec, archive);
+
+	archive_read(archive, &record->checksum, sizeof(CRC32_t));
+	debug("stored checksum: %lu", (unsigned long)record->checksum);
+	debug("extracted checksum: %lu", (unsigned long)outsum);
+	if (!zar_tunables.verify && is_format(record, zar_format_raw)) {
+		debug("%s: not verified", record->path);
+	} else if (outsum != record->checksum) {
+		error(EX_DATAERR, "%s: checksum (%lu) stored in %s does not match extracted checksum (%lu)",
+		      record->path, (unsigned long)record->checksum, archive->path, (unsigned long)outsum);
+	}
+}
+
+
+/** Extract the record at the archive's current position.
+ *
+ * The directory it goes in must already exist: see make_parent_directory().
+ */
+void zar_extract_file(ZarFileRecord* record, ZarHandle* archive)
+{
+	debug("extracting file record %s", record->path);
+	read_file_record_header(record, archive);
+	extract_file_data(record, archive);
+}
+
+/* Leading bytes of file types whose data is compressed already. */
+static const struct {
+	size_t offset;
+	size_t length;
+	const char* magic;
+} compressed_magic[] = {
+	{ 0, 2, "\x1f\x8b" },                 /* gzip */
+	{ 0, 4, "PK\x03\x04" },               /* zip, jar, apk, docx... */
+	{ 0, 3, "BZh" },                      /* bzip2 */
+	{ 0, 6, "\xfd" "7zXZ\x00" },          /* xz */
+	{ 0, 4, "\x28\xb5\x2f\xfd" },         /* zstd */
+	{ 0, 4, "\x04\x22\x4d\x18" },         /* lz4 */
+	{ 0, 6, "7z\xbc\xaf\x27\x1c" },       /* 7-Zip */
+	{ 0, 4, "Rar!" },                     /* rar */
+	{ 0, 3, "\xff\xd8\xff" },             /* JPEG */
+	{ 0, 8, "\x89PNG\r\n\x1a\n" },        /* PNG */
+	{ 0, 4, "GIF8" },                     /* GIF */
+	{ 8, 4, "WEBP" },                     /* WebP, in a RIFF */
+	{ 4, 4, "ftyp" },                     /* MP4, MOV, HEIC... */
+	{ 0, 4, "\x1a\x45\xdf\xa3" },         /* Matroska, WebM */
+	{ 0, 3, "ID3" },                      /* MP3 */
+	{ 0, 4, "OggS" },                     /* Ogg */
+	{ 0, 4, "fLaC" },                     /* FLAC */
+	{ 0, 4, "wOF2" },                     /* WOFF2 */
+};
+
+/* How much of the start of a file to look at, and the least worth looking at. */
+#define ZAR_SAMPLE_SIZE 16384
+#define ZAR_SAMPLE_MIN 4096
+
+
+/** Guess from its first bytes whether data is too dense to compress.
+ *
+ * Known magic numbers settle it. Otherwise the estimate is how many byte
+ * values are in play, n squared over the sum of the squared counts: 256 for
+ * noise, which is what compressed data looks like, a few dozen for text.
+ */
+static bool is_incompressible(const unsigned char* sample, size_t n)
+{
+	for (size_t i = 0; i < sizeof(compressed_magic) / sizeof(compressed_magic[0]); i++) {
+		size_t offset = compressed_magic[i].offset;
+		size_t length = compressed_magic[i].length;
+		if (n >= offset + length && memcmp(sample + offset, compressed_magic[i].magic, length) == 0)
+			return true;
+	}
+
+	uint64_t counts[256] = { 0 };
+	for (size_t i = 0; i < n; i++)
+		counts[sample[i]]++;
+	uint64_t squares = 0;
+	for (size_t i = 0; i < 256; i++)
+		squares += counts[i] * counts[i];
+	return squares > 0 && (uint64_t)n * n > 200 * squares;
+}
+
+
+/** True if a look at the start of the file says deflate would be wasted on it. */
+static bool sample_is_incompressible(const char* path)
+{
+	if (system_filesize(path) < ZAR_SAMPLE_MIN)
+		return false;
+
+	FILE* infile = fopen(path, "rb");
+	if (infile == NULL)
+		error(EX_IOERR, "failed opening %s (%s)", path, strerror(errno));
+	unsigned char sample[ZAR_SAMPLE_SIZE];
+	size_t n = fread(sample, 1, sizeof(sample), infile);
+	if (ferror(infile))
+		error(EX_IOERR, "%s: read failed: %s", path, strerror(errno));
+	fclose(infile);
+
+	return is_incompressible(sample, n);
+}
+
+
+/** Pick the format a new record's data will be stored in.
+ *
+ * --level 0 and --codec raw store everything. Otherwise files that are compressed already,
+ * going by a sample of their first bytes, are stored and the rest go through
+ * zar_tunables.codec. record_codec_file() gives up on anything that slipped
+ * through.
+ */
+static void choose_format(ZarFileRecord* record)
+{
+	if (!compressing() || sample_is_incompressible(record->path)) {
+		memcpy(record->format, zar_format_raw, sizeof(record->format));
+	} else {
+		memcpy(record->format, zar_tunables.codec->format, sizeof(record->format));
+	}
+}
+
+
+/** True if the record's file is big enough to deflate in parallel chunks. */
+static bool is_chunked(const ZarFileRecord* record, ZarOffset_t size)
+{
+	return zar_tunables.chunk_size > 0
+	    && is_format(record, zar_format_deflate)
+	    && size > (ZarOffset_t)zar_tunables.chunk_size;
+}
+
+
+/** Write the file named by record to out in the record's format.
+ *
+ * Sets the record's length, checksum, and datasum fields. archive is where
+ * the record goes next, which only deduplicated records need to know: it's
+ * NULL when encoding ahead of time.
+ */
+static void encode_file_record(ZarFileRecord* record, ZarSink* out, ZarHandle* archive)
+{
+	out->summing = true;
+	out->checksum = 0;
+
+	FILE* infile = fopen(record->path, "rb");
+	if (infile == NULL)
+		error(EX_IOERR, "failed opening %s (%s)", record->path, strerror(errno));
+
+	ZarOffset_t size = system_filesize(record->path);
+	if (is_chunked(record, size))
+		record->length = record_deflate_chunked(record, infile, size, out);
+	else if (is_format(record, zar_format_dedup))
+		record->length = record_dedup_file(record, infile, out, archive);
+	else if (is_format(record, zar_format_raw))
+		record->length = record_raw_file(record, infile, out);
+	else
+		record->length = record_codec_file(record, codec_find(record->format), infile, out);
+
+	if (record->length < 0) {
+		/* The codec gave up: store it instead. */
+		memcpy(record->format, zar_format_raw, sizeof(record->format));
+		sink_reset(out);
+		rewind(infile);
+		record->length = record_raw_file(record, infile, out);
+	}
+
+	/* Raw data may have gone around the sink, but it's the file itself. */
+	record->datasum = is_format(record, zar_format_raw) ? record->checksum : out->checksum;
+
+	fclose(infile);
+}
+
+
+/** Write the fields of a record that precede its data, all of them known. */
+static void write_file_record_header(ZarFileRecord* record, ZarHandle* archive)
+{
+	record->start = output_tell(archive);
+	xtrace("start of record at %lld bytes", (long long)record->start);
+
+	record->offset = (ZarOffset_t)strlen(record->path) + 1
+	               + sizeof(record->format)
+	               + sizeof(ZarOffset_t)
+	               + record->length
+	               + sizeof(CRC32_t);
+	fwrite(&record->offset, 1, sizeof(ZarOffset_t), archive->handle);
+	put_string(record->path, archive->handle);
+	fputc(record->format[0], archive->handle);
+	fputc(record->format[1], archive->handle);
+	fwrite(&record->length, 1, sizeof(ZarOffset_t), archive->handle);
+}
+
+
+static void write_file_record_checksum(ZarFileRecord* record, ZarHandle* archive)
+{
+	if (fwrite(&record->checksum, 1, sizeof(CRC32_t), archive->handle) != sizeof(CRC32_t))
+		error(EX_IOERR, "%s: failed writing %s: %s", archive->path, record->path, strerror(errno));
+
+	/* A stream can't tell us where it's got to, but the record knows its length. */
+	if (archive->stream)
+		archive->cursor = record->start + (ZarOffset_t)sizeof(ZarOffset_t) + record->offset;
+}
+
+
+/** Append a record whose data has already been encoded into sink.
+ *
+ * Everything about the record is known up front, so nothing needs to be
+ * patched afterwards. The sink is closed.
+ */
+static void write_encoded_file_record(ZarFileRecord* record, ZarSink* sink, ZarHandle* archive)
+{
+	write_file_record_header(record, archive);
+
+	if (sink->spilled) {
+		ZarSink out;
+		sink_open_file(&out, archive->handle, archive->path);
+		rewind(sink->file);
+		copy_blocks(sink->file, sink->name, &out, sink->total, NULL);
+	} else if (fwrite(sink->data, 1, sink->length, archive->handle) != sink->length) {
+		error(EX_IOERR, "%s: failed writing %s: %s", archive->path, record->path, strerror(errno));
+	}
+	sink_close(sink);
+
+	write_file_record_checksum(record, archive);
+}
+
+
+/** Append a raw record whose length and checksum are already known.
+ *
+ * The data is copied from the file in the kernel where possible.
+ */
+static void write_copied_file_record(ZarFileRecord* record, ZarHandle* archive)
+{
+	FILE* infile = fopen(record->path, "rb");
+	if (infile == NULL)
+		error(EX_IOERR, "failed opening %s (%s)", record->path, strerror(errno));
+
+	write_file_record_header(record, archive);
+	ZarSink out;
+	sink_open_file(&out, archive->handle, archive->path);
+	copy_file_range_to(infile, record->path, 0, &out, record->length);
+	if (fgetc(infile) != EOF)
+		error(EX_IOERR, "%s: file grew while being archived.", record->path);
+	fclose(infile);
+
+	write_file_record_checksum(record, archive);
+}
+
+
+/** Append a raw record, its length taken from the size of the file.
+ *
+ * The header goes first, so nothing needs to be patched afterwards. The file
+ * is checksummed in a pass of its own and then copied in the kernel where
+ * possible.
+ */
+static void write_raw_file_record(ZarFileRecord* record, ZarHandle* archive)
+{
+	FILE* infile = fopen(record->path, "rb");
+	if (infile == NULL)
+		error(EX_IOERR, "failed opening %s (%s)", record->path, strerror(errno));
+	record->length = system_filesize(record->path);
+	if (record->length < 0)
+		error(EX_IOERR, "%s: stat() failed: %s", record->path, strerror(errno));
+
+	write_file_record_header(record, archive);
+	ZarSink out;
+	sink_open_file(&out, archive->handle, archive->path);
+	record->checksum = 0;
+	if (system_has_copy_range() && !archive->stream) {
+		copy_blocks(infile, record->path, NULL, record->length, &record->checksum);
+		copy_file_range_to(infile, record->path, 0, &out, record->length);
+	} else {
+		copy_blocks(infile, record->path, &out, record->length, &record->checksum);
+	}
+	if (fgetc(infile) != EOF)
+		error(EX_IOERR, "%s: file grew while being archived.", record->path);
+	fclose(infile);
+	record->datasum = record->checksum;
+	debug("%s: file checksum: %lu", record->path, (unsigned long)record->checksum);
+
+	write_file_record_checksum(record, archive);
+}
+
+
+/** Continue the CRC of a volume's records with a record that has been written.
+ *
+ * Only the header fields are summed here. The data is folded in from the
+ * record's datasum, so nothing is read back from the archive.
+ */
+static CRC32_t add_record_checksum(CRC32_t crc, const ZarFileRecord* record)
+{
+	crc = crc_update(crc, &record->offset, sizeof(ZarOffset_t));
+	crc = crc_update(crc, record->path, strlen(record->path) + 1);
+	crc = crc_update(crc, record->format, sizeof(record->format));
+	crc = crc_update(crc, &record->length, sizeof(ZarOffset_t));
+	crc = crc_combine(crc, record->datasum, record->length);
+	return crc_update(crc, &record->checksum, sizeof(CRC32_t));
+}
+
+
+/** Fill in the volume's row for a record that has been written. */
+static void finish_record(ZarVolumeRecord* volume, size_t row, const ZarFileRecord* record)
+{
+	ZarRecordTable* table = &volume->records;
+	table->starts[row] = record->start;
+	table->lengths[row] = record->offset + (ZarOffset_t)sizeof(ZarOffset_t);
+	table->checksums[row] = record->checksum;
+	memcpy(table->formats[row], record->format, sizeof(record->format));
+	volume->checksum = add_record_checksum(volume->checksum, record);
+}
+
+
+/* Room left in the part of a split archive being written. See write_volume(). */
+struct PartSpace {
+	/* Most bytes the part can take, or 0 if there's no limit. */
+	ZarOffset_t limit;
+	/* What the volume's trailer will take, with a file map of its records so far. */
+	ZarOffset_t trailer;
+};
+
+
+static void part_space_init(struct PartSpace* space, ZarOffset_t limit)
+{
+	space->limit = limit;
+	/*
+	 * The 0 after the records, the file map's length and encoding, the
+	 * checksum and length of the records, where the file map is, and the
+	 * end mark. See write_trailer().
+	 */
+	space->trailer = (ZarOffset_t)sizeof(ZarOffset_t) + (ZarOffset_t)sizeof(ZarOffset_t)
+	               + (ZarOffset_t)sizeof(zar_filemap_encoding) + 4 + 8
+	               + (ZarOffset_t)sizeof(ZarOffset_t) + 4;
+}
+
+
+/** Count the file map entry of a record that has been written against the part. */
+static void part_space_add(struct PartSpace* space, const char* path)
+{
+	space->trailer += (ZarOffset_t)sizeof(ZarOffset_t) + (ZarOffset_t)strlen(path) + 1;
+}
+
+
+/** Whether the part still fits in its limit, if the volume was finished off now. */
+static bool part_space_fits(const struct PartSpace* space, ZarHandle* archive)
+{
+	return space->limit == 0 || output_tell(archive) - archive->base + space->trailer <= space->limit;
+}
+
+
+/** Take back the records written since start, which didn't fit in the part.
+ *
+ * checksum is what the volume's was before them. The next thing written goes
+ * over them, and whatever's left of them is cut off once the part is finished.
+ */
+static void take_back_records(ZarVolumeRecord* volume, ZarHandle* archive,
+                              ZarOffset_t start, CRC32_t checksum)
+{
+	debug("%s: %lld bytes of records don't fit in part %zu, leaving them for the next",
+	      archive->path, (long long)(output_tell(archive) - start), archive->part + 1);
+	if (system_seek(archive->handle, start - archive->base, SEEK_SET) != 0)
+		error(EX_IOERR, "%s: failed seeking back to %lld: %s",
+		      archive->path, (long long)start, strerror(errno));
+	volume->checksum = checksum;
+}
+
+
+/* An encoded record waiting for the writer. */
+struct EncodedRecord {
+	ZarSink sink;
+	/* Left for the writer to encode itself, in parallel chunks. */
+	bool deferred;
+	/* Raw and checksummed, for the writer to copy in the kernel. */
+	bool copy;
+	/* Working copy of the record, until its row of the table is filled in. */
+	ZarFileRecord record;
+};
+
+
+/* Shared between zar_create() and the workers encoding its records. */
+struct CreateJobs {
+	ZarVolumeRecord* volume;
+	/* One slot per job in the pool's window, indexed by job % nslots. */
+	struct EncodedRecord* slots;
+	size_t nslots;
+};
+
+
+static void encode_job(void* context, size_t index)
+{
+	struct CreateJobs* jobs = context;
+	struct EncodedRecord* slot = &jobs->slots[index % jobs->nslots];
+	ZarFileRecord* record = &slot->record;
+	init_file_record(record, jobs->volume->records.paths[index]);
+
+	choose_format(record);
+	slot->deferred = is_chunked(record, system_filesize(record->path));
+	if (slot->deferred)
+		return;
+
+	slot->copy = is_format(record, zar_format_raw) && system_has_copy_range();
+	if (slot->copy) {
+		FILE* infile = fopen(record->path, "rb");
+		if (infile == NULL)
+			error(EX_IOERR, "failed opening %s (%s)", record->path, strerror(errno));
+		record->checksum = 0;
+		record->length = copy_blocks(infile, record->path, NULL, -1, &record->checksum);
+		record->datasum = record->checksum;
+		fclose(infile);
+		return;
+	}
+
+	sink_open_memory(&slot->sink, record->path);
+	encode_file_record(record, &slot->sink, NULL);
+}
+
+
+/** Write the volume's records using zar_tunables.jobs worker threads.
+ *
+ * Workers encode records into memory, spilling big ones to temporary files,
+ * while this thread appends the finished records in file map order. Files big
+ * enough to be chunked are left for this thread, which deflates them with
+ * threads of its own. Raw files are only checksummed by the workers, and this
+ * thread copies them over in the kernel. The archive comes out byte for byte the same as writing
+ * the records one at a time.
+ *
+ * Stops at the first record after the first that doesn't fit in space.
+ * Returns how many were written.
+ */
+static size_t write_file_records_parallel(ZarVolumeRecord* volume, ZarHandle* archive,
+                                          struct PartSpace* space)
+{
+	struct CreateJobs jobs;
+	jobs.volume = volume;
+	/* Enough to keep every worker busy while the writer catches up. */
+	jobs.nslots = 2 * zar_tunables.jobs;
+	jobs.slots = calloc(jobs.nslots, sizeof(struct EncodedRecord));
+	if (jobs.slots == NULL)
+		error(EX_OSERR, "unable to allocate %zu record buffers", jobs.nslots);
+
+	size_t count = volume->records.count;
+	ZarPool* pool = pool_start(zar_tunables.jobs, count, jobs.nslots, encode_job, &jobs);
+	for (size_t i=0; i < volume->records.count; ++i) {
+		struct EncodedRecord* slot = &jobs.slots[i % jobs.nslots];
+		ZarFileRecord* record = &slot->record;
+		pool_wait(pool, i);
+		ZarOffset_t start = output_tell(archive);
+		CRC32_t checksum = volume->checksum;
+		info("adding %s to archive %s", record->path, archive->path);
+		if (slot->deferred) {
+			zar_write_file_record(record, archive);
+		} else if (slot->copy) {
+			write_copied_file_record(record, archive);
+		} else {
+			write_encoded_file_record(record, &slot->sink, archive);
+		}
+		finish_record(volume, i, record);
+		part_space_add(space, record->path);
+		if (i > 0 && !part_space_fits(space, archive)) {
+			take_back_records(volume, archive, start, checksum);
+			count = i;
+			break;
+		}
+		pool_release(pool, i);
+	}
+	if (count < volume->records.count)
+		pool_cancel(pool);
+	pool_finish(pool);
+
+	/* Anything encoded for records that didn't fit is done again for the next part. */
+	for (size_t i=0; i < jobs.nslots; ++i)
+		sink_close(&jobs.slots[i].sink);
+	free(jobs.slots);
+	return count;
+}
+
+
+/*
+ * Streamed volumes.
+ *
+ * A stream can't be rewound to fill in the file map once the records have
+ * been written, so a volume written to one has an empty file map, and the
+ * real one follows its records instead:
+ *
+ *   - An offset of 0 where the next record would start.
+ *   - The file map, as zar_write_filemap() writes it.
+ *   - Checksum and length of the records, as in the volume header.
+ *   - Where that file map starts.
+ *   - The end mark.
+ *
+ * Reading a stream, that means getting past every record to reach the file
+ * map. Anything else can find it from the end of the archive.
+ */
+
+
+/** Parse a file map of maplength bytes into volume's records.
+ *
+ * The archive must be just past the file map's length. The last record's
+ * length is left for the caller, who knows where the records end.
+ */
+static void read_filemap(ZarVolumeRecord* volume, ZarHandle* archive, ZarOffset_t maplength)
+{
+	/* Use the map where it lies, or slurp it: one read however many members. */
+	const char* map = (const char*)archive_view(archive, maplength);
+	if (map == NULL) {
+		volume->filemapdata = malloc((size_t)maplength);
+		if (volume->filemapdata == NULL)
+			error(EX_OSERR, "%s: unable to allocate %lld bytes for file map",
+			      archive->path, (long long)maplength);
+		archive_read(archive, volume->filemapdata, (size_t)maplength);
+		map = volume->filemapdata;
+	}
+
+	const char* mapend = map + maplength;
+	const char* encoding = map;
+	const char* entries = memchr(encoding, '\0', (size_t)maplength);
+	if (entries == NULL)
+		error(EX_DATAERR, "%s: bad file map encoding.", archive->path);
+	++entries;
+	debug("%s: file map is & paths are encoded as %s", archive->path, encoding);
+
+	/* Count the entries first so nothing has to grow as we go. */
+	size_t count = 0;
+	for (const char* p = entries; p < mapend; ++count) {
+		const char* nul = p + sizeof(ZarOffset_t) < mapend
+		                ? memchr(p + sizeof(ZarOffset_t), '\0', (size_t)(mapend - p - sizeof(ZarOffset_t)))
+		                : NULL;
+		if (nul == NULL)
+			error(EX_DATAERR, "%s: corrupt file map entry %zu.", archive->path, count);
+		p = nul + 1;
+	}
+	debug("%s: file map has %zu entries", archive->path, count);
+
+	ZarRecordTable* table = &volume->records;
+	table_reserve(table, count);
+	for (const char* p = entries; p < mapend; ) {
+		ZarOffset_t offset;
+		memcpy(&offset, p, sizeof(offset));
+		const char* path = p + sizeof(offset);
+		p = path + strlen(path) + 1;
+		xtrace("%s: file map entry %lld %s", archive->path, (long long)offset, path);
+
+		size_t row = table_add(table, path, offset);
+		if (row > 0)
+			table->lengths[row-1] = offset - table->starts[row-1];
+	}
+	xtrace("Finished reading file map entries at %lld", (long long)archive_tell(archive));
+}
+
+
+/** The last record runs up to end. */
+static void set_last_length(ZarRecordTable* table, ZarOffset_t end)
+{
+	if (table->count == 0)
+		return;
+	size_t last = table->count - 1;
+	if (end > table->starts[last])
+		table->lengths[last] = end - table->starts[last];
+}
+
+
+/** Read past the records of a streamed volume, and the 0 after them.
+ *
+ * The archive must be at the first record. Every byte of the records is
+ * added to checksum. Returns their length.
+ */
+static ZarOffset_t skip_stream_records(ZarHandle* archive, CRC32_t* checksum)
+{
+	ZarOffset_t length = 0;
+	for (;;) {
+		ZarOffset_t offset;
+		archive_read(archive, &offset, sizeof(offset));
+		if (offset == 0)
+			return length;
+		if (offset < 0)
+			error(EX_DATAERR, "%s: corrupt record %lld bytes into the records.",
+			      archive->path, (long long)length);
+		*checksum = crc_update(*checksum, &offset, sizeof(offset));
+		archive_skip(archive, offset, checksum);
+		length += (ZarOffset_t)sizeof(offset) + offset;
+	}
+}
+
+
+/** Read what follows a streamed volume's records, starting just past the 0. */
+static void read_trailer(ZarVolumeRecord* volume, ZarHandle* archive)
+{
+	volume->filemap = archive_tell(archive);
+	ZarOffset_t maplength;
+	archive_read(archive, &maplength, sizeof(ZarOffset_t));
+	debug("%s: trailing file map is %lld bytes long", archive->path, (long long)maplength);
+	if (maplength <= 0)
+		error(EX_DATAERR, "%s: bad file map length.", archive->path);
+	read_filemap(volume, archive, maplength);
+
+	archive_read(archive, &volume->checksum, 4);
+	archive_read(archive, &volume->offset, 8);
+	ZarOffset_t filemap;
+	int32_t end;
+	archive_read(archive, &filemap, sizeof(filemap));
+	archive_read(archive, &end, 4);
+	if (end != zar_end_mark || filemap != volume->filemap)
+		error(EX_DATAERR, "%s: bad volume trailer.", archive->path);
+	volume->end = archive_tell(archive);
+
+	/* The records end with the 0 just before the file map. */
+	set_last_length(&volume->records, volume->filemap - (ZarOffset_t)sizeof(ZarOffset_t));
+}
+
+
+/** Find and read the trailer of a streamed volume, in an archive that isn't a stream.
+ *
+ * It's at the end of the archive, before its index, or of the part of a
+ * split archive the volume is in, unless more volumes were added after it. Then the way there
+ * is hopping from record to record.
+ */
+static void find_trailer(ZarVolumeRecord* volume, ZarHandle* archive)
+{
+	ZarOffset_t size = archive->nparts > 0
+	                 ? archive->partstarts[find_part(archive, volume->begin) + 1]
+	                 : archive_size(archive);
+	if (archive->footer >= 0 && archive->footer < size)
+		size = archive->footer;
+	ZarOffset_t tail = (ZarOffset_t)(sizeof(ZarOffset_t) + sizeof(ZarOffset_t) + 4);
+	if (size - tail > volume->begin) {
+		ZarOffset_t length, filemap;
+		int32_t end;
+		archive_seek(archive, size - tail);
+		archive_read(archive, &length, sizeof(length));
+		archive_read(archive, &filemap, sizeof(filemap));
+		archive_read(archive, &end, 4);
+		/* It's this volume's if its records lead up to it. */
+		if (end == zar_end_mark && filemap == volume->begin + length + (ZarOffset_t)sizeof(ZarOffset_t)) {
+			archive_seek(archive, filemap);
+			read_trailer(volume, archive);
+			return;
+		}
+	}
+
+	ZarOffset_t here = volume->begin;
+	for (;;) {
+		ZarOffset_t offset;
+		archive_seek(archive, here);
+		archive_read(archive, &offset, sizeof(offset));
+		if (offset == 0)
+			break;
+		if (offset < 0)
+			error(EX_DATAERR, "%s: corrupt record at %lld bytes.", archive->path, (long long)here);
+		here += (ZarOffset_t)sizeof(offset) + offset;
+	}
+	read_trailer(volume, archive);
+}
+
+
+/** Read on to the file map of a streamed volume being read from a stream.
+ *
+ * The archive must be at the first record. Returns the CRC-32 of the records
+ * it read past.
+ */
+static CRC32_t read_past_records(ZarVolumeRecord* volume, ZarHandle* archive)
+{
+	CRC32_t checksum = 0;
+	ZarOffset_t length = skip_stream_records(archive, &checksum);
+	read_trailer(volume, archive);
+	if (length != volume->offset)
+		error(EX_DATAERR, "%s: read %lld bytes of records, but the volume has %lld.",
+		      archive->path, (long long)length, (long long)volume->offset);
+	return checksum;
+}
+
+
+/** Write what follows a streamed volume's records. See read_trailer(). */
+static void write_trailer(ZarVolumeRecord* volume, ZarHandle* archive)
+{
+	ZarOffset_t none = 0;
+	fwrite(&none, 1, sizeof(none), archive->handle);
+	archive->cursor += sizeof(none);
+
+	zar_write_filemap(volume, archive);
+	fwrite(&volume->checksum, 1, 4, archive->handle);
+	fwrite(&volume->offset, 1, 8, archive->handle);
+	fwrite(&volume->filemap, 1, sizeof(ZarOffset_t), archive->handle);
+	fwrite(&zar_end_mark, 1, 4, archive->handle);
+	if (fflush(archive->handle) != 0)
+		error(EX_IOERR, "%s: failed writing archive: %s", archive->path, strerror(errno));
+	if (archive->stream)
+		archive->cursor += 4 + 8 + (ZarOffset_t)sizeof(ZarOffset_t) + 4;
+}
+
+
+/*
+ * Volumes.
+ *
+ * An archive is one volume after another, each a header followed by the
+ * records it lists. The length of a volume's records says where the next one
+ * starts. Appending to an archive adds a volume, so a path can be recorded in
+ * more than one: its last record is the current one.
+ */
+
+
+/** A volume from before their lengths were recorded runs to the end of the archive. */
+static bool runs_to_end(const ZarVolumeRecord* volume)
+{
+	return !volume->streamed && volume->offset == 0 && volume->records.count > 0;
+}
+
+
+/** Read the rest of a volume record, after its start mark. */
+static void read_volume_fields(ZarVolumeRecord* volume, ZarHandle* archive)
+{
+	volume->filemap = archive_tell(archive);
+	ZarOffset_t maplength;
+	archive_read(archive, &maplength, sizeof(ZarOffset_t));
+	debug("%s: file map is %lld bytes long", archive->path, (long long)maplength);
+
+	if (maplength < 0)
+		error(EX_DATAERR, "%s: bad file map length.", archive->path);
+	volume->streamed = maplength == 0;
+	if (!volume->streamed)
+		read_filemap(volume, archive, maplength);
+
+	archive_read(archive, &volume->checksum, 4);
+	debug("%s: volume checksum: %ld", archive->path, volume->checksum); /* TODO: to string! */
+	archive_read(archive, &volume->offset, 8);
+	debug("%s: offset to backup volume record %ld", archive->path, volume->offset);
+
+	/* 
+	 * Parse the name and version of what created this volume.
+	 */
+	char app[16], ver[16];
+	archive_read_string(archive, app, sizeof(app));
+	archive_read_string(archive, ver, sizeof(ver));
+	info("volume created by %s/%s", app, ver);
+
+	volume->begin = archive_tell(archive);
+	if (!volume->streamed) {
+		/* The last record runs to the end of the records, or the archive if they weren't measured. */
+		volume->end = volume->begin + volume->offset;
+		if (runs_to_end(volume) && !archive->stream)
+			volume->end = archive_size(archive);
+		set_last_length(&volume->records, volume->end);
+	} else if (!archive->stream) {
+		/* Go and get the file map from after the records, then come back to them. */
+		find_trailer(volume, archive);
+		archive_seek(archive, volume->begin);
+	}
+}
+
+
+/** Read the header of the volume after volume, or return NULL if it's the last.
+ *
+ * On a stream the archive mustn't be past the end of volume, and if volume
+ * was streamed, its trailer must have been read.
+ */
+static ZarVolumeRecord* next_volume(const ZarVolumeRecord* volume, ZarHandle* archive)
+{
+	if (runs_to_end(volume))
+		return NULL;
+	if (archive->stream) {
+		ZarOffset_t here = archive_tell(archive);
+		if (here < volume->end)
+			archive_skip(archive, volume->end - here, NULL);
+	} else {
+		archive_seek(archive, volume->end);
+	}
+	if (archive_at_end(archive))
+		return NULL;
+
+	int32_t mark;
+	archive_read(archive, &mark, 4);
+	if (mark == zar_index_mark) {
+		/* The index follows the last volume. A stream reads on through it to the end. */
+		if (archive->stream) {
+			ZarOffset_t length;
+			archive_read(archive, &length, sizeof(length));
+			if (length < 0)
+				error(EX_DATAERR, "%s: bad index length.", archive->path);
+			archive_skip(archive, length + 4 + (ZarOffset_t)sizeof(ZarOffset_t) + 4, NULL);
+		}
+		return NULL;
+	}
+	if (mark != zar_start_mark)
+		error(EX_DATAERR, "%s: bad volume header.", archive->path);
+
+	ZarVolumeRecord* next = zar_create_volume_header();
+	read_volume_fields(next, archive);
+	return next;
+}
+
+
+/** Add volume after the last of archive->volumes, which owns it from then on. */
+static void add_volume(ZarHandle* archive, ZarVolumeRecord* volume)
+{
+	ZarVolumeRecord** volumes = realloc(archive->volumes, (archive->nvolumes + 1) * sizeof(ZarVolumeRecord*));
+	if (volumes == NULL)
+		error(EX_OSERR, "unable to allocate memory");
+	volumes[archive->nvolumes++] = volume;
+	archive->volumes = volumes;
+}
+
+
+/*
+ * The index.
+ *
+ * An archive ends with an index of every volume and record in it, so it can
+ * be opened by reading its tail, rather than every volume header on the way
+ * there:
+ *
+ *   - The index mark, and the length of the index.
+ *   - The number of volumes. For each of them, where its records begin and
+ *     where it ends, the length and checksum of its records, and the number
+ *     of them. Then for each record, where it starts, its length, the
+ *     checksum of its file, its format, the size and modification time its
+ *     file had when it was recorded, and its path.
+ *   - The CRC-32 of the index, and where the index mark is.
+ *   - The index end mark.
+ *
+ * Archives from before there was an index are read a volume at a time, and
+ * so is a stream, which only gets to the index once it's past everything.
+ */
+
+
+/* Where the index ends: the bytes after the index itself, up to the end mark. */
+#define ZAR_INDEX_TAIL (4 + sizeof(ZarOffset_t) + 4)
+
+
+/** Set archive->footer to where the archive's index starts, or -1 if it hasn't got one.
+ *
+ * Only the marks and lengths are checked, so it's cheap enough to do on
+ * opening. The archive is left at its start.
+ */
+static void find_footer(ZarHandle* archive)
+{
+	archive->footer = -1;
+	ZarOffset_t size = archive_size(archive);
+	ZarOffset_t tail = (ZarOffset_t)(sizeof(ZarOffset_t) + 4);
+	if (size < 4 + (ZarOffset_t)sizeof(ZarOffset_t) + (ZarOffset_t)ZAR_INDEX_TAIL)
+		return;
+
+	ZarOffset_t offset;
+	int32_t mark;
+	archive_seek(archive, size - tail);
+	archive_read(archive, &offset, sizeof(offset));
+	archive_read(archive, &mark, 4);
+	if (mark == zar_index_end_mark && offset >= 0
+	    && offset <= size - 4 - (ZarOffset_t)sizeof(ZarOffset_t) - (ZarOffset_t)ZAR_INDEX_TAIL) {
+		ZarOffset_t length;
+		archive_seek(archive, offset);
+		archive_read(archive, &mark, 4);
+		archive_read(archive, &length, sizeof(length));
+		if (mark == zar_index_mark
+		    && length == size - offset - 4 - (ZarOffset_t)sizeof(ZarOffset_t) - (ZarOffset_t)ZAR_INDEX_TAIL)
+			archive->footer = offset;
+	}
+	debug("%s: index at %lld", archive->path, (long long)archive->footer);
+	archive_seek(archive, 0);
+}
+
+
+/** Take the next n bytes of an index, ending at end, calling error() if there aren't that many. */
+static const char* take_index(ZarHandle* archive, const char** p, const char* end, void* dest, size_t n)
+{
+	const char* at = *p;
+	if (n > (size_t)(end - at))
+		error(EX_DATAERR, "%s: index ends too soon.", archive->path);
+	if (dest != NULL)
+		memcpy(dest, at, n);
+	*p = at + n;
+	return at;
+}
+
+
+/** Read every volume from the archive's index into archive->volumes.
+ *
+ * Returns false, with archive->volumes untouched, if the archive hasn't got
+ * an index or it fails its checksum. The archive must be at its start, and
+ * that's where it's left then. Otherwise it's left past the index.
+ */
+static bool read_footer(ZarHandle* archive)
+{
+	if (archive->stream || archive->footer < 0)
+		return false;
+
+	ZarOffset_t length;
+	archive_seek(archive, archive->footer + 4);
+	archive_read(archive, &length, sizeof(length));
+	const char* index = (const char*)archive_view(archive, length);
+	char* data = NULL;
+	if (index == NULL) {
+		data = malloc(length > 0 ? (size_t)length : 1);
+		if (data == NULL)
+			error(EX_OSERR, "%s: unable to allocate %lld bytes for the index",
+			      archive->path, (long long)length);
+		archive_read(archive, data, (size_t)length);
+		index = data;
+	}
+	CRC32_t checksum;
+	archive_read(archive, &checksum, sizeof(checksum));
+	if (crc_update(0, index, (size_t)length) != checksum) {
+		warn("%s: index is corrupt, reading every volume instead.", archive->path);
+		free(data);
+		archive_seek(archive, 0);
+		return false;
+	}
+
+	const char* p = index;
+	const char* end = index + length;
+	ZarOffset_t nvolumes;
+	take_index(archive, &p, end, &nvolumes, sizeof(nvolumes));
+	for (ZarOffset_t v=0; v < nvolumes; ++v) {
+		ZarVolumeRecord* volume = zar_create_volume_header();
+		ZarOffset_t count;
+		take_index(archive, &p, end, &volume->begin, sizeof(ZarOffset_t));
+		take_index(archive, &p, end, &volume->end, sizeof(ZarOffset_t));
+		take_index(archive, &p, end, &volume->offset, sizeof(ZarOffset_t));
+		take_index(archive, &p, end, &volume->checksum, sizeof(CRC32_t));
+		take_index(archive, &p, end, &count, sizeof(count));
+		if (count < 0 || count > end - p)
+			error(EX_DATAERR, "%s: bad record count in index.", archive->path);
+
+		ZarRecordTable* table = &volume->records;
+		table_reserve(table, (size_t)count);
+		for (ZarOffset_t i=0; i < count; ++i) {
+			ZarOffset_t start;
+			take_index(archive, &p, end, &start, sizeof(start));
+			const char* fields = take_index(archive, &p, end, NULL,
+			                                sizeof(ZarOffset_t) + sizeof(CRC32_t) + 2);
+			const char* stat = take_index(archive, &p, end, NULL, 2 * sizeof(int64_t));
+			const char* nul = memchr(p, '\0', (size_t)(end - p));
+			if (nul == NULL)
+				error(EX_DATAERR, "%s: corrupt index entry.", archive->path);
+
+			size_t row = table_add(table, p, start);
+			memcpy(&table->lengths[row], fields, sizeof(ZarOffset_t));
+			memcpy(&table->checksums[row], fields + sizeof(ZarOffset_t), sizeof(CRC32_t));
+			memcpy(table->formats[row], fields + sizeof(ZarOffset_t) + sizeof(CRC32_t), 2);
+			memcpy(&table->sizes[row], stat, sizeof(int64_t));
+			memcpy(&table->mtimes[row], stat + sizeof(int64_t), sizeof(int64_t));
+			p = nul + 1;
+		}
+		add_volume(archive, volume);
+	}
+
+	/* The volumes' paths point into it, so it's kept until the archive is closed. */
+	archive->footerdata = data;
+	debug("%s: %zu volumes from the index", archive->path, archive->nvolumes);
+	return true;
+}
+
+
+/** Length of the index of archive->volumes, without its marks, length, checksum and offset. */
+static ZarOffset_t footer_length(const ZarHandle* archive)
+{
+	ZarOffset_t length = (ZarOffset_t)sizeof(ZarOffset_t);
+	for (size_t v=0; v < archive->nvolumes; ++v) {
+		const ZarRecordTable* table = &archive->volumes[v]->records;
+		length += 3 * (ZarOffset_t)sizeof(ZarOffset_t) + (ZarOffset_t)sizeof(CRC32_t)
+		        + (ZarOffset_t)sizeof(ZarOffset_t);
+		for (size_t i=0; i < table->count; ++i)
+			length += 2 * (ZarOffset_t)sizeof(ZarOffset_t) + (ZarOffset_t)sizeof(CRC32_t) + 2
+			        + 2 * (ZarOffset_t)sizeof(int64_t) + (ZarOffset_t)strlen(table->paths[i]) + 1;
+	}
+	return length;
+}
+
+
+/** Write part of the index, adding it to checksum. */
+static void put_index(ZarHandle* archive, CRC32_t* checksum, const void* data, size_t n)
+{
+	if (fwrite(data, 1, n, archive->handle) != n)
+		error(EX_IOERR, "%s: failed writing index: %s", archive->path, strerror(errno));
+	*checksum = crc_update(*checksum, data, n);
+}
+
+
+/** Write an index of archive->volumes where the archive is, which must be its end. */
+static void write_footer(ZarHandle* archive)
+{
+	ZarOffset_t offset = output_tell(archive);
+	ZarOffset_t length = footer_length(archive);
+	debug("%s: %lld byte index of %zu volumes at %lld", archive->path,
+	      (long long)length, archive->nvolumes, (long long)offset);
+	fwrite(&zar_index_mark, 1, 4, archive->handle);
+	fwrite(&length, 1, sizeof(length), archive->handle);
+
+	CRC32_t checksum = 0;
+	ZarOffset_t nvolumes = (ZarOffset_t)archive->nvolumes;
+	put_index(archive, &checksum, &nvolumes, sizeof(nvolumes));
+	for (size_t v=0; v < archive->nvolumes; ++v) {
+		const ZarVolumeRecord* volume = archive->volumes[v];
+		const ZarRecordTable* table = &volume->records;
+		ZarOffset_t count = (ZarOffset_t)table->count;
+		put_index(archive, &checksum, &volume->begin, sizeof(ZarOffset_t));
+		put_index(archive, &checksum, &volume->end, sizeof(ZarOffset_t));
+		put_index(archive, &checksum, &volume->offset, sizeof(ZarOffset_t));
+		put_index(archive, &checksum, &volume->checksum, sizeof(CRC32_t));
+		put_index(archive, &checksum, &count, sizeof(count));
+		for (size_t i=0; i < table->count; ++i) {
+			put_index(archive, &checksum, &table->starts[i], sizeof(ZarOffset_t));
+			put_index(archive, &checksum, &table->lengths[i], sizeof(ZarOffset_t));
+			put_index(archive, &checksum, &table->checksums[i], sizeof(CRC32_t));
+			put_index(archive, &checksum, table->formats[i], 2);
+			put_index(archive, &checksum, &table->sizes[i], sizeof(int64_t));
+			put_index(archive, &checksum, &table->mtimes[i], sizeof(int64_t));
+			put_index(archive, &checksum, table->paths[i], strlen(table->paths[i]) + 1);
+		}
+	}
+
+	fwrite(&checksum, 1, sizeof(checksum), archive->handle);
+	fwrite(&offset, 1, sizeof(offset), archive->handle);
+	fwrite(&zar_index_end_mark, 1, 4, archive->handle);
+	if (fflush(archive->handle) != 0)
+		error(EX_IOERR, "%s: failed writing archive: %s", archive->path, strerror(errno));
+	if (archive->stream)
+		archive->cursor += 4 + (ZarOffset_t)sizeof(length) + length + (ZarOffset_t)ZAR_INDEX_TAIL;
+	archive->footer = offset;
+}
+
+
+/** Read the header of every volume into archive->volumes. It mustn't be a stream.
+ *
+ * From the index if there is one, otherwise from the start of the archive.
+ */
+static void read_volumes(ZarHandle* archive)
+{
+	if (read_footer(archive))
+		return;
+
+	ZarVolumeRecord* volume = zar_create_volume_header();
+	zar_read_volume_record(volume, archive);
+	while (volume != NULL) {
+		add_volume(archive, volume);
+		volume = next_volume(volume, archive);
+	}
+	debug("%s: %zu volumes", archive->path, archive->nvolumes);
+}
+
+
+/** Whether row of archive->volumes[v] is the current record of its path. */
+static bool is_current(ZarHandle* archive, size_t v, size_t row)
+{
+	const char* path = archive->volumes[v]->records.paths[row];
+	if (index_find(volume_index(archive->volumes[v]), path) != row)
+		return false;
+	for (size_t w=v+1; w < archive->nvolumes; ++w) {
+		if (index_find(volume_index(archive->volumes[w]), path) != INDEX_NONE)
+			return false;
+	}
+	return true;
+}
+
+
+/** How many of the count files from files onwards go in a solid block together.
+ *
+ * Files small enough that deflating them on their own can't refer back far,
+ * up to zar_tunables.solid_size bytes of them.
+ */
+static size_t solid_run(char* files[], size_t count)
+{
+	ZarOffset_t total = 0;
+	size_t n = 0;
+	for (; n < count; ++n) {
+		ZarOffset_t size = system_filesize(files[n]);
+		if (size < 0 || size >= ZAR_DEFLATE_WINDOW || total + size > (ZarOffset_t)zar_tunables.solid_size)
+			break;
+		total += size;
+	}
+	return n;
+}
+
+
+/** Write the count files from row onwards as a solid block. See struct SolidFields. */
+static void write_solid_block(ZarVolumeRecord* volume, size_t row, size_t count, ZarHandle* archive)
+{
+	const ZarRecordTable* table = &volume->records;
+	ZarFileRecord* records = malloc(count * sizeof(ZarFileRecord));
+	struct SolidFields* fields = malloc(count * sizeof(struct SolidFields));
+	size_t size = zar_tunables.block_size;
+	unsigned char* in = malloc(size);
+	unsigned char* outblock = malloc(size);
+	if (records == NULL || fields == NULL || in == NULL || outblock == NULL)
+		error(EX_OSERR, "unable to allocate memory for a solid block of %zu files", count);
+
+	/* Where each file goes in the block: they're small, so their size won't change much. */
+	ZarOffset_t total = 0;
+	for (size_t i=0; i < count; ++i) {
+		init_file_record(&records[i], table->paths[row+i]);
+		memcpy(records[i].format, zar_format_solid, sizeof(records[i].format));
+		fields[i].block = 0;
+		fields[i].position = total;
+		fields[i].size = system_filesize(records[i].path);
+		total += fields[i].size;
+	}
+	debug("%s: solid block of %zu files, %lld bytes", archive->path, count, (long long)total);
+
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	if (deflateInit2(&z, zar_tunables.level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		error(EX_SOFTWARE, "%s: deflateInit2() failed: %s", archive->path, z.msg);
+
+	ZarSink sink;
+	sink_open_memory(&sink, records[0].path);
+	sink.summing = true;
+	sink.checksum = 0;
+	sink_write(&sink, &fields[0], sizeof(fields[0]));
+	sink_write(&sink, &total, sizeof(total));
+	ZarOffset_t length = (ZarOffset_t)(sizeof(fields[0]) + sizeof(total));
+
+	/* Every file, one after another, into the one stream. */
+	for (size_t i=0; i < count; ++i) {
+		ZarFileRecord* record = &records[i];
+		FILE* infile = fopen(record->path, "rb");
+		if (infile == NULL)
+			error(EX_IOERR, "failed opening %s (%s)", record->path, strerror(errno));
+		ZarOffset_t inlength = 0;
+		int flush;
+		do {
+			size_t got = fread(in, 1, size, infile);
+			if (ferror(infile))
+				error(EX_IOERR, "%s: read failed: %s", record->path, strerror(errno));
+			record->checksum = crc_update(record->checksum, in, got);
+			inlength += got;
+			flush = feof(infile) && i == count - 1 ? Z_FINISH : Z_NO_FLUSH;
+
+			z.next_in = in;
+			z.avail_in = (uInt)got;
+			do {
+				z.next_out = outblock;
+				z.avail_out = (uInt)size;
+				if (deflate(&z, flush) == Z_STREAM_ERROR)
+					error(EX_SOFTWARE, "%s: deflate() failed: %s", record->path, z.msg);
+				size_t have = size - z.avail_out;
+				sink_write(&sink, outblock, have);
+				length += have;
+			} while (z.avail_out == 0);
+		} while (!feof(infile));
+		fclose(infile);
+		if (inlength != fields[i].size)
+			error(EX_IOERR, "%s: file changed size while being archived.", record->path);
+	}
+	deflateEnd(&z);
+	free(in);
+	free(outblock);
+
+	records[0].length = length;
+	records[0].datasum = sink.checksum;
+	info("adding %s to archive %s", records[0].path, archive->path);
+	write_encoded_file_record(&records[0], &sink, archive);
+	finish_record(volume, row, &records[0]);
+
+	/* The rest just say where they are in it. */
+	for (size_t i=1; i < count; ++i) {
+		fields[i].block = records[0].start;
+		sink_open_memory(&sink, records[i].path);
+		sink.summing = true;
+		sink.checksum = 0;
+		sink_write(&sink, &fields[i], sizeof(fields[i]));
+		records[i].length = (ZarOffset_t)sizeof(fields[i]);
+		records[i].datasum = sink.checksum;
+		info("adding %s to archive %s", records[i].path, archive->path);
+		write_encoded_file_record(&records[i], &sink, archive);
+		finish_record(volume, row + i, &records[i]);
+	}
+
+	free(fields);
+	free(records);
+}
+
+
+/** Write a volume recording files where the archive is.
+ *
+ * If limit isn't 0, the volume is streamed, so it can stop anywhere, and it
+ * stops before the first file after the first that would take the part of
+ * the archive it's in past limit bytes. Each file is recorded before that's
+ * decided, so what it takes is known for sure, and taken back if it doesn't
+ * fit. Returns how many of the files were recorded. The volume is added to
+ * zar->volumes, for the index.
+ */
+static size_t write_volume(ZarHandle* zar, char* files[], size_t count, ZarOffset_t limit)
+{
+	ZarVolumeRecord* volume = zar_create_volume_header();
+	volume->streamed = zar->stream || limit > 0;
+	table_reserve(&volume->records, count);
+	volume->checksum = 0;
+	volume->offset = 0;
+	for (size_t i=0; i < count; ++i) {
+		size_t row = table_add(&volume->records, files[i], 0);
+		/* Before the file is read, so a change while it is shows up next time. */
+		system_filestat(files[i], &volume->records.sizes[row], &volume->records.mtimes[row]);
+		debug("adding %s to file map for archive %s", files[i], zar->path);
+	}
+
+	/* Chunks are shared within a volume, so a new one starts from scratch. */
+	if (zar_tunables.dedup)
+		zar->chunks = chunk_index_create();
+
+	zar_write_volume_record(volume, zar);
+	ZarOffset_t records = output_tell(zar);
+	volume->begin = records;
+
+	/*
+	 * Deduplicating needs every earlier record written before the next is
+	 * encoded, and a solid block needs all of its files at once.
+	 */
+	bool solid = zar_tunables.solid_size > 0 && compressing() && zar->chunks == NULL;
+	struct PartSpace space;
+	part_space_init(&space, limit);
+	double start = system_clock();
+	if (zar_tunables.jobs > 1 && zar->chunks == NULL && !solid) {
+		count = write_file_records_parallel(volume, zar, &space);
+	} else {
+		ZarFileRecord record;
+		for (size_t i=0; i < count; ++i) {
+			ZarOffset_t at = output_tell(zar);
+			CRC32_t checksum = volume->checksum;
+			size_t n = solid ? solid_run(files + i, count - i) : 0;
+			if (n > 1) {
+				write_solid_block(volume, i, n, zar);
+			} else {
+				n = 1;
+				init_file_record(&record, files[i]);
+				info("adding %s to archive %s", record.path, zar->path);
+				zar_write_file_record(&record, zar);
+				finish_record(volume, i, &record);
+			}
+			for (size_t j=0; j < n; ++j)
+				part_space_add(&space, files[i+j]);
+			if (i > 0 && !part_space_fits(&space, zar)) {
+				take_back_records(volume, zar, at, checksum);
+				count = i;
+				break;
+			}
+			i += n - 1;
+		}
+	}
+	volume->records.count = count;
+	volume->offset = output_tell(zar) - records;
+	report_throughput(zar->path, volume->offset, system_clock() - start);
+	chunk_index_free(zar->chunks);
+	zar->chunks = NULL;
+	debug("%s: %lld bytes of records, checksum %08lx", zar->path,
+	      (long long)volume->offset, (unsigned long)volume->checksum);
+
+	if (volume->streamed) {
+		write_trailer(volume, zar);
+		volume->end = output_tell(zar);
+		add_volume(zar, volume);
+		return count;
+	}
+
+	/*
+	 * Now that we know where every record landed, fill in the file map,
+	 * and the checksum and length of the records that follow it.
+	 */
+	fpos_t end = mark_position(zar);
+	if (system_seek(zar->handle, volume->filemap - zar->base, SEEK_SET) != 0)
+		error(EX_IOERR, "%s: failed seeking back to file map", zar->path);
+	zar_write_filemap(volume, zar);
+	fwrite(&volume->checksum, 1, 4, zar->handle);
+	fwrite(&volume->offset, 1, 8, zar->handle);
+	if (fsetpos(zar->handle, &end) != 0)
+		error(EX_IOERR, "%s: failed seeking back to end of archive", zar->path);
+
+	volume->end = output_tell(zar);
+	add_volume(zar, volume);
+	return count;
+}
+
+
+/** Cut the last part of a split archive off where it's got to. */
+static void finish_part(ZarHandle* zar)
+{
+	/* A record that didn't fit may have been taken back from past the end. */
+	ZarOffset_t size = output_tell(zar) - zar->base;
+	if (system_truncate(zar->handle, size) != 0)
+		error(EX_IOERR, "%s: failed writing part %zu: %s", zar->path, zar->nparts, strerror(errno));
+	zar->partstarts[zar->nparts] = zar->base + size;
+	info("%s: part %zu is %lld bytes", zar->path, zar->nparts, (long long)size);
+}
+
+
+/** Write files as volumes in new parts of a split archive, as many as it takes, then the index.
+ *
+ * Each part is zar_tunables.volume_size bytes at most, or holds one volume
+ * of all the files if that's 0. The index goes at the end of the last part,
+ * or in a part of its own if it doesn't fit there.
+ */
+static void write_parts(ZarHandle* zar, char* files[], size_t count)
+{
+	ZarOffset_t limit = (ZarOffset_t)zar_tunables.volume_size;
+	size_t done = 0;
+	do {
+		add_part(zar, 0);
+		open_part(zar, zar->nparts - 1, "w+b");
+		done += write_volume(zar, files + done, count - done, limit);
+		finish_part(zar);
+	} while (done < count);
+
+	ZarOffset_t size = 4 + (ZarOffset_t)sizeof(ZarOffset_t) + footer_length(zar) + (ZarOffset_t)ZAR_INDEX_TAIL;
+	if (limit > 0 && output_tell(zar) - zar->base + size > limit) {
+		add_part(zar, 0);
+		open_part(zar, zar->nparts - 1, "w+b");
+	}
+	write_footer(zar);
+	finish_part(zar);
+}
+
+
+void zar_create(const char* archive, char* files[], size_t count)
+{
+	info("archive name:%s", archive);
+	debug("archive members:%d", count);
+
+	if (zar_tunables.volume_size > 0 && strcmp(archive, "-") == 0)
+		error(EX_USAGE, "can't split a stream into parts: name the archive with -f.");
+	/* It would write fine, but extracting has to go back for shared chunks. */
+	if (zar_tunables.dedup && strcmp(archive, "-") == 0)
+		error(EX_USAGE, "can't deduplicate a stream: name the archive with -f.");
+
+	ZarHandle* zar = zar_open(archive, 'w');
+	if (zar == NULL)
+		return;
+
+	if (zar->stem == NULL) {
+		write_volume(zar, files, count, 0);
+		write_footer(zar);
+		zar_close(zar);
+		return;
+	}
+
+	write_parts(zar, files, count);
+
+	/* Parts left over from a bigger archive of the same name would look like more of this one. */
+	for (size_t n=zar->nparts+1; ; ++n) {
+		char* path = part_path(zar->stem, n);
+		int removed = remove(path);
+		if (removed == 0)
+			debug("removed stale part %s", path);
+		free(path);
+		if (removed != 0)
+			break;
+	}
+	/* And an archive under the name itself would be read instead of the parts. */
+	if (system_filesize(zar->stem) >= 0 && !system_isdir(zar->stem) && remove(zar->stem) == 0)
+		debug("removed stale archive %s", zar->stem);
+	zar_close(zar);
+}
+
+
+/** Take the index off the end of a split archive, so more parts can follow it. */
+static void remove_footer_part(ZarHandle* zar)
+{
+	size_t last = zar->nparts - 1;
+	if (zar->footer == zar->partstarts[last]) {
+		/* It's a part of its own. */
+		char* path = part_path(zar->stem, last + 1);
+		fclose(zar->handle);
+		zar->handle = NULL;
+		if (remove(path) != 0)
+			error(EX_IOERR, "%s: failed removing %s: %s", zar->path, path, strerror(errno));
+		free(path);
+		zar->nparts--;
+	} else {
+		open_part(zar, last, "r+b");
+		if (system_truncate(zar->handle, zar->footer - zar->base) != 0)
+			error(EX_IOERR, "%s: failed writing part %zu: %s", zar->path, last + 1, strerror(errno));
+		zar->partstarts[zar->nparts] = zar->footer;
+	}
+	zar->footer = -1;
+}
+
+
+/** Whether zar -u should record the file at path again.
+ *
+ * It has if its size or modification time, to the nanosecond, isn't what the
+ * index says it was when it was last recorded. Records read from an archive
+ * without an index don't have those, so they fall back on whether the file
+ * has been modified since the archive was.
+ */
+static bool needs_update(ZarHandle* archive, const char* path, int64_t since)
+{
+	for (size_t v=archive->nvolumes; v-- > 0; ) {
+		ZarVolumeRecord* volume = archive->volumes[v];
+		size_t row = index_find(volume_index(volume), path);
+		if (row == INDEX_NONE)
+			continue;
+
+		int64_t size, mtime;
+		system_filestat(path, &size, &mtime);
+		if (volume->records.mtimes[row] < 0)
+			return mtime >= since;
+		return size != volume->records.sizes[row] || mtime != volume->records.mtimes[row];
+	}
+	return true;
+}
+
+
+void zar_append(const char* archive, char* files[], size_t count, bool update)
+{
+	info("archive name:%s", archive);
+	debug("archive members:%d", count);
+
+	if (strcmp(archive, "-") == 0)
+		error(EX_USAGE, "can't append to a pipe: name the archive with -f.");
+	/* Before it's opened, which may create it. */
+	int64_t since = system_mtime(archive);
+
+	ZarHandle* zar = zar_open(archive, 'a');
+	if (zar == NULL)
+		return;
+	if (zar->stream)
+		error(EX_USAGE, "%s: can't append to a stream.", zar->path);
+	if (zar->nparts > 0) {
+		/* New volumes go in new parts, so it's the last one that was modified. */
+		char* last = part_path(zar->stem, zar->nparts);
+		since = system_mtime(last);
+		free(last);
+	} else if (zar_tunables.volume_size > 0) {
+		error(EX_USAGE, "%s: only an archive that was created split can be added to in parts.", zar->path);
+	}
+
+	/* Find the end of the last volume. Only the headers are read. */
+	ZarOffset_t size = archive_size(zar);
+	if (size > 0) {
+		read_volumes(zar);
+		if (runs_to_end(zar->volumes[zar->nvolumes-1]))
+			error(EX_DATAERR, "%s: the length of the last volume isn't recorded, so nothing can follow it.",
+			      zar->path);
+		/* Over the index, if there is one: a new one replaces it. */
+		if (zar->nparts == 0)
+			archive_seek(zar, zar->footer >= 0 ? zar->footer : size);
+	}
+
+	char** added = files;
+	size_t nadded = count;
+	if (update) {
+		added = malloc((count ? count : 1) * sizeof(char*));
+		if (added == NULL)
+			error(EX_OSERR, "unable to allocate memory");
+		nadded = 0;
+		for (size_t i=0; i < count; ++i) {
+			if (needs_update(zar, files[i], since))
+				added[nadded++] = files[i];
+			else
+				debug("%s is up to date", files[i]);
+		}
+	}
+	info("%s: adding %zu of %zu files", zar->path, nadded, count);
+
+	if (nadded > 0 && zar->nparts > 0) {
+		if (zar->footer >= 0)
+			remove_footer_part(zar);
+		write_parts(zar, added, nadded);
+	} else if (nadded > 0) {
+		write_volume(zar, added, nadded, 0);
+		write_footer(zar);
+	}
+
+	if (added != files)
+		free(added);
+	zar_close(zar);
+}
+
+
+static void list_row(size_t row, void* context)
+{
+	const ZarRecordTable* table = context;
+	if (debug_level >= DEBUG_info)
+		printf("%12lld %12lld  %s\n", (long long)table->starts[row],
+		       (long long)table->lengths[row], table->paths[row]);
+	else
+		puts(table->paths[row]);
+}
+
+
+/** List the members of volume matching members, or all of them if count is 0. */
+static void list_volume(ZarVolumeRecord* volume, char* members[], size_t count, bool* found)
+{
+	ZarRecordTable* table = &volume->records;
+	if (count == 0) {
+		for (size_t row=0; row < table->count; ++row)
+			list_row(row, table);
+	}
+	for (size_t i=0; i < count; ++i) {
+		if (index_is_pattern(members[i])) {
+			index_match(volume_index(volume), members[i], list_row, table);
+		} else {
+			size_t row = index_find(volume_index(volume), members[i]);
+			if (row != INDEX_NONE) {
+				list_row(row, table);
+				found[i] = true;
+			}
+		}
+	}
+}
+
+
+void zar_list(const char* archive, char* members[], size_t count)
+{
+	ZarHandle* zar;
+	ZarVolumeRecord* volume;
+
+	zar = zar_open(archive, 'r');
+	if (zar == NULL)
+		return;
+	if (zar_tunables.mmap)
+		zar_map(zar);
+
+	bool* found = calloc(count ? count : 1, sizeof(bool));
+	if (found == NULL)
+		error(EX_OSERR, "unable to allocate memory");
+
+	/* Everything we need is in the index, or else the file maps: no need to visit the records. */
+	if (read_footer(zar)) {
+		for (size_t v=0; v < zar->nvolumes; ++v)
+			list_volume(zar->volumes[v], members, count, found);
+	} else {
+		volume = zar_create_volume_header();
+		zar_read_volume_record(volume, zar);
+		while (volume != NULL) {
+			if (volume->streamed && zar->stream)
+				read_past_records(volume, zar);
+			list_volume(volume, members, count, found);
+
+			ZarVolumeRecord* next = next_volume(volume, zar);
+			zar_free_volume_header(volume);
+			volume = next;
+		}
+	}
+
+	/* A pattern matching nothing is fine, a name that isn't there isn't. */
+	for (size_t i=0; i < count; ++i) {
+		if (!found[i] && !index_is_pattern(members[i]))
+			error(EX_DATAERR, "%s: not found in archive %s", members[i], zar->path);
+	}
+	free(found);
+	zar_close(zar);
+}
+
+
+/** CRC-32 of the next length bytes of the archive, read straight through. */
+static CRC32_t checksum_records(ZarHandle* archive, ZarOffset_t length)
+{
+	CRC32_t checksum = 0;
+	archive_skip(archive, length, &checksum);
+	return checksum;
+}
+
+
+/** Print the file map at the archive's position, for zar_info().
+ *
+ * Returns how many entries it has, or -1 if it's empty because the real one
+ * trails the records.
+ */
+static ZarOffset_t dump_filemap(ZarHandle* zar)
+{
+	char buffer[ZAR_MAX_PATH];
+
+	ZarOffset_t size;
+	archive_read(zar, &size, sizeof(size));
+	printf("Size of file map: %lld bytes\n", (long long)size);
+	if (size == 0) {
+		printf("File map: follows the file records\n");
+		return -1;
+	}
+	size -= archive_read_string(zar, buffer, sizeof(buffer));
+	printf("Encoding of file map: %s\n", buffer);
+	memset(buffer, 0, sizeof(buffer));
+	printf("File map:\n\n");
+	ZarOffset_t nbytes = 0;
+	ZarOffset_t count = 0;
+	while (nbytes < size) {
+		ZarOffset_t offset;
+		archive_read(zar, &offset, sizeof(offset));
+		nbytes += sizeof(offset);
+		nbytes += archive_read_string(zar, buffer, sizeof(buffer));
+		printf("\tpath: \"%s\" \toffset: %lld bytes\n", buffer, (long long)offset);
+		memset(buffer, 0, sizeof(buffer));
+		++count;
+	}
+	return count;
+}
+
+
+/** Read part of the index for dump_footer(), adding it to checksum. */
+static void read_index(ZarHandle* zar, CRC32_t* checksum, void* dest, size_t n)
+{
+	archive_read(zar, dest, n);
+	*checksum = crc_update(*checksum, dest, n);
 }
 
 
-/** Store raw file data in archive.
+/** Print the index at the archive's position, just past its mark, for zar_info(). */
+static void dump_footer(ZarHandle* zar)
+{
+	char buffer[ZAR_MAX_PATH];
+
+	ZarOffset_t offset = archive_tell(zar) - 4;
+	ZarOffset_t length;
+	archive_read(zar, &length, sizeof(length));
+	printf("\nIndex at %lld bytes\n", (long long)offset);
+	printf("Length of index: %lld bytes\n", (long long)length);
+
+	CRC32_t actual = 0;
+	ZarOffset_t nvolumes;
+	read_index(zar, &actual, &nvolumes, sizeof(nvolumes));
+	for (ZarOffset_t v=0; v < nvolumes; ++v) {
+		ZarOffset_t begin, end, size, count;
+		CRC32_t checksum;
+		read_index(zar, &actual, &begin, sizeof(begin));
+		read_index(zar, &actual, &end, sizeof(end));
+		read_index(zar, &actual, &size, sizeof(size));
+		read_index(zar, &actual, &checksum, sizeof(checksum));
+		read_index(zar, &actual, &count, sizeof(count));
+		printf("\nVolume %lld: %lld records in %lld bytes from %lld, checksum %08lx, ends at %lld\n\n",
+		       (long long)v, (long long)count, (long long)size, (long long)begin,
+		       (unsigned long)checksum, (long long)end);
+		for (ZarOffset_t i=0; i < count; ++i) {
+			ZarOffset_t start, reclength;
+			CRC32_t crc;
+			char format[2];
+			read_index(zar, &actual, &start, sizeof(start));
+			read_index(zar, &actual, &reclength, sizeof(reclength));
+			read_index(zar, &actual, &crc, sizeof(crc));
+			read_index(zar, &actual, format, sizeof(format));
+			int64_t filesize, mtime;
+			read_index(zar, &actual, &filesize, sizeof(filesize));
+			read_index(zar, &actual, &mtime, sizeof(mtime));
+			size_t n = archive_read_string(zar, buffer, sizeof(buffer));
+			actual = crc_update(actual, buffer, n);
+			char name[3] = { format[0], format[1], '\0' };
+			printf("\tpath: \"%s\" \toffset: %lld bytes \tlength: %lld bytes \tcrc: %08lx \tformat: %s"
+			       " \tsize: %lld bytes \tmtime: %lld\n",
+			       buffer, (long long)start, (long long)reclength, (unsigned long)crc,
+			       format[0] == 0 && format[1] == 0 ? "raw" : name,
+			       (long long)filesize, (long long)mtime);
+		}
+	}
+
+	CRC32_t checksum;
+	ZarOffset_t where;
+	int32_t magic;
+	archive_read(zar, &checksum, sizeof(checksum));
+	printf("\nCRC32 checksum of index: %08lx\n", (unsigned long)checksum);
+	archive_read(zar, &where, sizeof(where));
+	printf("Offset of index: %lld bytes\n", (long long)where);
+	archive_read(zar, &magic, 4);
+	printf("Index end mark: %s\n", magic == zar_index_end_mark ? "ok" : "BAD");
+	printf("Index checksum: %s\n", actual == checksum && where == offset ? "ok" : "BAD");
+}
+
+
+/*
+ * This is kind of a unit test like function.
  *
- * Call this to copy the file into the archive without any mutations.
- * Updates the record's checksum field with the inputs CRC-32.
- * Returns the length of the data in bytes.
+ * It dumps info with a minimum of help from our zar_* functions.
  */
-static ZarOffset_t record_raw_file(ZarFileRecord* record, ZarHandle* archive)
+void zar_info(const char* archive)
 {
-	ZarOffset_t length = 0;
+	ZarHandle* zar = zar_open(archive, 'r');
+	if (zar == NULL)
+		return;
+	if (zar_tunables.mmap)
+		zar_map(zar);
 
-	xtrace("%s: recording raw file to archive %s.", record->path, archive->path);
+	info("Testing for the magic number.");
 
-	FILE* infile = fopen(record->path, "rb");
-	if (infile == NULL) {
-		warn("failed opening %s (%s)", record->path, strerror(errno));
-		return -1;
+	int32_t magic;
+	archive_read(zar, &magic, 4);
+	if (magic != zar_start_mark) {
+		puts("NOT A ZAR ARCHIVE!");
+		goto DONE;
 	}
 
-	record->checksum = crc32(0L, Z_NULL, 0);
-	int c;
-	while ((c = fgetc(infile)) != EOF) {
-		length += 1;
-		record->checksum = crc32(record->checksum, (Bytef*)&c, 1);
-		if (fputc(c, archive->handle) == EOF)
-			error(EX_IOERR, "failed writing byte %d from %s to archive %s",
-			      length, record->path, archive->path);
+	printf("Info for ZAR archive: %s\n\n", zar->path);
+
+	for (int n=0; ; ++n) {
+		printf("%sVolume %d\n", n > 0 ? "\n" : "", n);
+
+		info("Decoding file map");
+		ZarOffset_t entries = dump_filemap(zar);
+		bool streamed = entries < 0;
+
+		CRC32_t checksum;
+		archive_read(zar, &checksum, sizeof(checksum));
+		printf("CRC32 checksum of file records: %08lx\n", (unsigned long)checksum);
+		ZarOffset_t size;
+		archive_read(zar, &size, sizeof(size));
+		printf("Length of file records: %lld bytes\n", (long long)size);
+
+		info("Decoding volume metadata");
+
+		/* App / Version */
+		char buffer[ZAR_MAX_PATH];
+		archive_read_string(zar, buffer, sizeof(buffer));
+		char* app = malloc(strlen(buffer) + 1);
+		if (app == NULL)
+			error(EX_OSERR, "malloc() failed");
+		strcpy(app, buffer);
+		memset(buffer, 0, sizeof(buffer));
+		archive_read_string(zar, buffer, sizeof(buffer));
+		char* ver = malloc(sizeof(strlen(buffer)) + 1);
+		if (ver == NULL)
+			error(EX_OSERR, "malloc() failed");
+		strcpy(ver, buffer);
+		printf("Volume was created by %s version %s\n", app, ver);
+		free(app);
+		free(ver);
+
+		if (streamed) {
+			/* Read on past the records to what follows them. */
+			info("Checking file records");
+			CRC32_t actual = 0;
+			ZarOffset_t length = skip_stream_records(zar, &actual);
+			printf("\nTrailer after %lld bytes of file records\n", (long long)length);
+			ZarOffset_t filemap = archive_tell(zar);
+			dump_filemap(zar);
+			archive_read(zar, &checksum, sizeof(checksum));
+			printf("CRC32 checksum of file records: %08lx\n", (unsigned long)checksum);
+			archive_read(zar, &size, sizeof(size));
+			printf("Length of file records: %lld bytes\n", (long long)size);
+			archive_read(zar, &filemap, sizeof(filemap));
+			printf("Offset of file map: %lld bytes\n", (long long)filemap);
+			archive_read(zar, &magic, 4);
+			printf("End mark: %s\n", magic == zar_end_mark ? "ok" : "BAD");
+			printf("File records checksum: %s\n", actual == checksum && length == size ? "ok" : "BAD");
+		} else if (size > 0) {
+			/* The records follow straight on from here. */
+			info("Checking file records");
+			CRC32_t actual = checksum_records(zar, size);
+			printf("File records checksum: %s\n", actual == checksum ? "ok" : "BAD");
+		} else if (entries > 0) {
+			printf("File records: run to the end of the archive\n");
+			break;
+		}
+
+		/* Then the next volume, if there is one, or the index. */
+		if (archive_at_end(zar))
+			break;
+		archive_read(zar, &magic, 4);
+		if (magic == zar_index_mark) {
+			dump_footer(zar);
+			break;
+		}
+		if (magic != zar_start_mark) {
+			puts("\nJUNK AFTER THE LAST VOLUME!");
+			break;
+		}
 	}
-	debug("%s: file checksum: %lu", record->path, record->checksum);
-	debug("%s: file length: %d", record->path, length);
 
-	if (feof(infile))
-		debug("end of %s", record->path);
-	fclose(infile);
+DONE:
+	zar_close(zar);
+	return;
+}
 
-	return length;
+/** Check a volume's checksum against its file records, which the archive must be at. */
+static void verify_volume(ZarVolumeRecord* volume, ZarHandle* zar)
+{
+	/* On a stream the file map is past the records, so they're checked on the way to it. */
+	bool passed = volume->streamed && zar->stream;
+	ZarOffset_t start = volume->begin;
+	double begin = system_clock();
+	CRC32_t checksum = passed ? read_past_records(volume, zar) : 0;
+
+	ZarOffset_t end = start + volume->offset;
+	const ZarRecordTable* table = &volume->records;
+	if (volume->offset == 0 && table->count > 0)
+		error(EX_DATAERR, "%s: volume has no checksum to verify.", zar->path);
+
+	/* Cheap sanity checks first: the file map must point into the records, in order. */
+	for (size_t i=0; i < table->count; ++i) {
+		ZarOffset_t offset = table->starts[i];
+		bool ok = i == 0 ? offset == start : offset > table->starts[i-1];
+		if (!ok || offset >= end)
+			error(EX_DATAERR, "%s: file map entry for %s is out of place.",
+			      zar->path, table->paths[i]);
+	}
+
+	/* Then one sequential pass over everything, without decoding any of it. */
+	if (!passed) {
+		begin = system_clock();
+		checksum = checksum_records(zar, volume->offset);
+	}
+	report_throughput(zar->path, volume->offset, system_clock() - begin);
+	if (checksum != volume->checksum)
+		error(EX_DATAERR, "%s: checksum (%08lx) of file records does not match volume checksum (%08lx)",
+		      zar->path, (unsigned long)checksum, (unsigned long)volume->checksum);
 }
 
 
-static void extract_raw_file(ZarFileRecord* record, ZarHandle* archive)
+/** Check that the index says the same as volume, the vth one read. */
+static void verify_indexed(ZarHandle* zar, size_t v, const ZarVolumeRecord* volume)
 {
-	debug("cur pos: %ld",ftell(archive->handle));
-	debug("offset: %ld", record->offset);
-	debug("length: %ld", record->length);
-	debug("checksum: %lu", record->checksum);
-
-	/* How far to skip from start of record to data to extract. */
-	ZarOffset_t skip =
-	        sizeof(ZarOffset_t)       /* Offset to end of record. */
-	      + 2                        /* Format bytes. */
-	      + strlen(record->path) + 1 /* NUL terminated path */
-	      + sizeof(ZarOffset_t)      /* Length of data */
-	      ;
+	const ZarVolumeRecord* indexed = v < zar->nvolumes ? zar->volumes[v] : NULL;
+	const ZarRecordTable* table = &volume->records;
+	bool ok = indexed != NULL
+	        && indexed->begin == volume->begin
+	        && indexed->offset == volume->offset
+	        && indexed->checksum == volume->checksum
+	        && indexed->records.count == table->count;
+	for (size_t i=0; ok && i < table->count; ++i) {
+		ok = indexed->records.starts[i] == table->starts[i]
+		  && indexed->records.lengths[i] == table->lengths[i]
+		  && strcmp(indexed->records.paths[i], table->paths[i]) == 0;
+	}
+	if (!ok)
+		error(EX_DATAERR, "%s: index doesn't match volume %zu.", zar->path, v);
+}
 
-	/* Seek from start of record to start of data in record. */
-	if (fseek(archive->handle, (long)skip, SEEK_CUR) != 0)
-		error(EX_IOERR, "Unable to seek to start of file data.");
-	debug("start of file data at pos: %ld", ftell(archive->handle));
 
-	/*
-	 * Pickle: doesn't handle directory issues. Yet.
-	 */
+void zar_verify(const char* archive)
+{
+	ZarHandle* zar = zar_open(archive, 'r');
+	if (zar == NULL)
+		return;
+	if (zar_tunables.mmap)
+		zar_map(zar);
+
+	/* The index is checked against every volume as it's read. */
+	bool indexed = read_footer(zar);
+	if (zar->footer >= 0 && !indexed)
+		error(EX_DATAERR, "%s: index checksum does not match.", zar->path);
+	if (indexed)
+		archive_seek(zar, 0);
+
+	size_t v = 0;
+	ZarOffset_t end = 0;
+	ZarVolumeRecord* volume = zar_create_volume_header();
+	zar_read_volume_record(volume, zar);
+	while (volume != NULL) {
+		verify_volume(volume, zar);
+		if (indexed)
+			verify_indexed(zar, v, volume);
+		++v;
+		end = volume->end;
+		ZarVolumeRecord* next = next_volume(volume, zar);
+		zar_free_volume_header(volume);
+		volume = next;
+	}
+	if (indexed && v != zar->nvolumes)
+		error(EX_DATAERR, "%s: index has %zu volumes, but the archive has %zu.", zar->path, zar->nvolumes, v);
 
-	FILE* outfile = fopen(record->path, "wb");
-	if (outfile == NULL)
-		error(EX_IOERR, "failed creating %s: %s", record->path, strerror(errno));
+	/* After the last volume there's the index, or nothing: anything else is a damaged index or junk. */
+	ZarOffset_t expected = zar->footer >= 0 ? zar->footer : zar->stream ? end : archive_size(zar);
+	if (end != expected)
+		error(EX_DATAERR, "%s: neither a volume nor an index at %lld bytes.", zar->path, (long long)end);
+	printf("%s: OK\n", zar->path);
 
-	CRC32_t outsum = crc32(0L, Z_NULL, 0);
-	debug("about to read from pos: %ld", ftell(archive->handle));
-	for (ZarOffset_t i=0; i < record->length; ++i) {
-		int c = fgetc(archive->handle);
-		if (c == EOF)
-			error(EX_IOERR, "%s: unexpected EOF.", archive->path);
-		debug("caught byte '%c'", c);
-		outsum = crc32(outsum, (Bytef*)&c, 1);
-		fputc(c, outfile);
-	}
-	debug("now at pos: %ld", ftell(archive->handle));
-	/* debug("%s: extracted %s as %d bytes / checksum %lu CRC-32.", */
-	      /* archive->path, record->path, record->length, record->checksum); */
-	debug("extracted: %s", record->path);
-	debug("extracted: %d bytes", record->length);
-	debug("stored checksum: %lu", record->checksum);
-	debug("extracted checksum: %lu", outsum);
-	if (outsum != record->checksum)
-		error(EX_DATAERR, "%s: checksum (%lu) stored in %s does not match extracted checksum (%s)",
-		      record->path, record->checksum, archive->path, outsum);
-
-	/* Seek to the end of this record. */
-	debug("cur pos: %ld",ftell(archive->handle));
-	skip = 1 + (record->offset - skip);
-	debug("skip how far? %ld", skip);
-	if (fseek(archive->handle, (long)skip, SEEK_CUR) != 0)
-		error(EX_IOERR, "Unable to seek to end of record.");
+	zar_close(zar);
 }
 
-void zar_extract_file(ZarFileRecord* record, ZarHandle* archive)
-{
-	debug("extracting file record %s", record->path);
-	fpos_t mark = mark_position(archive);
-	zar_read_file_record(record, archive);
-	fsetpos(archive->handle, &mark);
 
-	if (record->format[0] != 0 || record->format[1] || 0)
-		error(EX_DATAERR, "%s: unsupported format: %c%c",
-		      archive->path, record->format[0], record->format[1]);
+/* Records picked out for extraction: a volume, and a row of its record table, apiece. */
+struct Selection {
+	size_t* volumes;
+	size_t* rows;
+	size_t count;
+	size_t capacity;
+	/* Where select_row() picks from. */
+	ZarHandle* archive;
+	size_t volume;
+};
 
-	char* dir = system_dirname(record->path);
-	if (dir != NULL && *dir != '.') {
-		if (system_mkdir(dir) != 0)
-			error(EX_OSERR, "cannot mkdir(): %s: %s", dir, strerror(errno));
-	}
-	free(dir);
 
-	extract_raw_file(record, archive);
+/** Pick row of selection->volume, if it's the current record of its path. */
+static void select_row(size_t row, void* context)
+{
+	struct Selection* selection = context;
+	if (!is_current(selection->archive, selection->volume, row))
+		return;
+	if (selection->count == selection->capacity) {
+		selection->capacity = selection->capacity ? 2 * selection->capacity : 16;
+		selection->volumes = realloc(selection->volumes, selection->capacity * sizeof(size_t));
+		selection->rows = realloc(selection->rows, selection->capacity * sizeof(size_t));
+		if (selection->volumes == NULL || selection->rows == NULL)
+			error(EX_OSERR, "unable to allocate memory");
+	}
+	selection->volumes[selection->count] = selection->volume;
+	selection->rows[selection->count++] = row;
 }
 
-void zar_create(const char* archive, char* files[], size_t count)
+
+static void make_parent_directory(ZarDirCache* dirs, const char* path)
 {
-	info("archive name:%s", archive);
-	debug("archive members:%d", count);
+	if (dircache_make_parent(dirs, path) != 0)
+		error(EX_OSERR, "cannot mkdir() for %s: %s", path, strerror(errno));
+}
 
-	ZarHandle* zar = zar_open(archive);
-	if (zar == NULL)
-		return;
 
-	ZarVolumeRecord* volume = zar_create_volume_header();
-	volume->nrecords = count;
-	volume->records = malloc(volume->nrecords * sizeof(ZarFileRecord));
-	debug("volume->records: %p", volume->records);
-	volume->checksum = 0;
-	volume->offset = 0;
-	for (size_t i=0; i < volume->nrecords; ++i) {
-		volume->records[i] = zar_create_file_record(files[i]);
-		debug("adding %s to file map for archive %s",
-		      volume->records[i]->path, zar->path);
-	}
-	/* archive->volumes[archive->nvolumes] = volume; */
-	/* archive->nvolumes++; */
+/* Shared between zar_extract() and the workers extracting its records. */
+struct ExtractJobs {
+	ZarHandle* archive;
+	/* Absolute path of the archive: zar_extract() has changed directory. */
+	const char* path;
+	/* Where each record to extract starts, in archive order. */
+	const ZarOffset_t* offsets;
+	/* Length of each record's file data, filled in as they're extracted. */
+	ZarOffset_t* lengths;
+	/* Read handles not being used by a worker. */
+	void* mutex;
+	ZarHandle** handles;
+	size_t nhandles;
+};
 
-	zar_write_volume_record(volume, zar);
 
-	for (size_t i=0; i < volume->nrecords; ++i) {
-		const char* file = files[i];
-		info("adding %s to archive %s", file, zar->path);
-		zar_write_file_record(volume->records[i], zar);
+/** A second read handle on archive, opened by path, with its own position.
+ *
+ * Shares the mapping if there is one. Free it with close_reader().
+ */
+static ZarHandle* open_reader(const ZarHandle* archive, const char* path)
+{
+	ZarHandle* r = malloc(sizeof(ZarHandle));
+	if (r == NULL)
+		error(EX_OSERR, "unable to allocate read handle for %s", archive->path);
+	*r = *archive;
+	if (archive->nparts > 0) {
+		/* Parts are opened by the absolute stem, like path. */
+		r->handle = NULL;
+		open_part(r, 0, "rb");
+	} else {
+		r->handle = fopen(path, "rb");
+		if (r->handle == NULL)
+			error(EX_IOERR, "Failed opening archive %s (%s)", archive->path, strerror(errno));
 	}
-
-	zar_close(zar);
+	r->cursor = 0;
+	r->block = NULL;
+	r->blockstart = -1;
+	return r;
 }
 
 
-void zar_list(const char* archive)
+static void close_reader(ZarHandle* reader)
 {
-	ZarHandle* zar;
-	ZarVolumeRecord* volume;
+	fclose(reader->handle);
+	free(reader->block);
+	free(reader);
+}
 
-	zar = zar_open(archive);
-	if (zar == NULL)
-		return;
 
-	/* Uhh, handle multi-volume archives? */
-	volume = zar_create_volume_header();
-	zar_read_volume_record(volume, zar);
-	for (size_t i=0; i < volume->nrecords; ++i) {
-		ZarFileRecord* record = volume->records[i];
-		debug("dumping file record %s", record->path);
+static void extract_job(void* context, size_t index)
+{
+	struct ExtractJobs* jobs = context;
+
+	/* There are never more handles than workers, so only the first jobs open one. */
+	system_mutex_lock(jobs->mutex);
+	ZarHandle* reader = jobs->nhandles > 0 ? jobs->handles[--jobs->nhandles] : NULL;
+	system_mutex_unlock(jobs->mutex);
+	if (reader == NULL)
+		reader = open_reader(jobs->archive, jobs->path);
+
+	ZarFileRecord record;
+	memset(&record, 0, sizeof(record));
+	archive_seek(reader, jobs->offsets[index]);
+	zar_extract_file(&record, reader);
+	jobs->lengths[index] = record.length;
+
+	system_mutex_lock(jobs->mutex);
+	jobs->handles[jobs->nhandles++] = reader;
+	system_mutex_unlock(jobs->mutex);
+}
 
-		/* We don't need to do this as we already know the path.
-		 * But hey, I wanna test this function >_<.
-		 */
-		zar_read_file_record(record, zar);
-	}
 
-	for (size_t i=0; i < volume->nrecords; ++i) {
-		free(volume->records[i]);
-	}
-	free(volume);
-	zar_close(zar);
+static int compare_offsets(const void* a, const void* b)
+{
+	ZarOffset_t x = *(const ZarOffset_t*)a;
+	ZarOffset_t y = *(const ZarOffset_t*)b;
+	return x < y ? -1 : x > y;
 }
 
 
-/*
- * This is kind of a unit test like function.
+/** Extract the records starting at offsets using zar_tunables.jobs worker threads.
  *
- * It dumps info with a minimum of help from our zar_* functions.
+ * Each worker reads through a handle of its own, so records are decoded and
+ * their files written concurrently, which is what matters for lots of small
+ * files. offsets is sorted so reads go through the archive in order, and
+ * duplicates are dropped so no two workers write the same file.
+ * Returns the total length of the records' file data.
  */
-void zar_info(const char* archive)
+static ZarOffset_t extract_records_parallel(ZarHandle* archive, const char* path,
+                                            ZarOffset_t* offsets, size_t count)
 {
-	ZarHandle* zar = zar_open(archive);
-	if (zar == NULL)
-		return;
-
-	info("Testing for the magic number.");
-
-	int32_t magic;
-	fread(&magic, 1, 4, zar->handle);
-	if (magic != zar_start_mark) {
-		puts("NOT A ZAR ARCHIVE!");
-		goto DONE;
+	qsort(offsets, count, sizeof(ZarOffset_t), compare_offsets);
+	size_t n = 0;
+	for (size_t i=0; i < count; ++i) {
+		if (n == 0 || offsets[i] != offsets[n-1])
+			offsets[n++] = offsets[i];
 	}
+	count = n;
+	if (count == 0)
+		return 0;
+
+	size_t nthreads = zar_tunables.jobs < count ? zar_tunables.jobs : count;
+	struct ExtractJobs jobs;
+	jobs.archive = archive;
+	jobs.path = path;
+	jobs.offsets = offsets;
+	jobs.lengths = calloc(count, sizeof(ZarOffset_t));
+	jobs.mutex = system_mutex_create();
+	jobs.handles = malloc(nthreads * sizeof(ZarHandle*));
+	jobs.nhandles = 0;
+	if (jobs.lengths == NULL || jobs.handles == NULL)
+		error(EX_OSERR, "unable to allocate memory to extract %zu records", count);
+	debug("%s: extracting %zu records on %zu threads", archive->path, count, nthreads);
+
+	ZarPool* pool = pool_start(nthreads, count, 0, extract_job, &jobs);
+	pool_finish(pool);
+
+	ZarOffset_t total = 0;
+	for (size_t i=0; i < count; ++i)
+		total += jobs.lengths[i];
+	for (size_t i=0; i < jobs.nhandles; ++i)
+		close_reader(jobs.handles[i]);
+	free(jobs.handles);
+	system_mutex_destroy(jobs.mutex);
+	free(jobs.lengths);
+
+	return total;
+}
 
-	printf("Info for ZAR archive: %s\n\n", zar->path);
 
-	puts("Volume 0");
+/** Extract records in the order they come, skipping those not asked for.
+ *
+ * For streams, which can only be read front to back, so members are looked
+ * for as records go by rather than in the file map. found[j] is set once a
+ * record matching members[j] has gone by. The archive must be at the first
+ * record. Extraction stops after the volume's last record: at the 0 after
+ * them if the volume was streamed, otherwise once every record in the file
+ * map has gone by. Returns the total length of the file data extracted.
+ */
+static ZarOffset_t extract_in_order(ZarVolumeRecord* volume, ZarHandle* archive,
+                                    ZarDirCache* dirs, char* members[], size_t count, bool* found)
+{
+	ZarOffset_t total = 0;
+	ZarFileRecord record;
+	for (size_t i=0; volume->streamed || i < volume->records.count; ++i) {
+		init_file_record(&record, "");
+		archive_read(archive, &record.offset, sizeof(ZarOffset_t));
+		if (volume->streamed && record.offset == 0)
+			break;
+		read_file_record_fields(&record, archive);
+
+		bool wanted = count == 0;
+		for (size_t j=0; j < count; ++j) {
+			bool match = index_is_pattern(members[j])
+			           ? index_glob(members[j], record.path)
+			           : strcmp(members[j], record.path) == 0;
+			if (match)
+				found[j] = wanted = true;
+		}
+		if (wanted) {
+			make_parent_directory(dirs, record.path);
+			extract_file_data(&record, archive);
+			total += record.length;
+		} else if (is_format(&record, zar_format_solid) && archive->stream) {
+			/* Records further on may be in its block, and there's no coming back for it. */
+			debug("skipping %s, but not its block", record.path);
+			struct SolidFields fields;
+			ZarOffset_t start = archive_tell(archive) - record_header_size(record.path);
+			archive_read(archive, &fields, sizeof(fields));
+			ZarOffset_t rest = record.length - (ZarOffset_t)sizeof(fields);
+			if (fields.block == 0)
+				load_solid_block(archive, start, rest);
+			else
+				archive_skip(archive, rest, NULL);
+			archive_skip(archive, (ZarOffset_t)sizeof(CRC32_t), NULL);
+		} else {
+			debug("skipping %s", record.path);
+			archive_skip(archive, record.length + (ZarOffset_t)sizeof(CRC32_t), NULL);
+		}
+	}
+	/* It shows the stream wasn't cut short, and leads on to the next volume. */
+	if (volume->streamed)
+		read_trailer(volume, archive);
+	return total;
+}
 
-	char buffer[64];
 
-	info("Decoding file map");
+/** Extract from every volume of a stream, with extract_in_order(). */
+static ZarOffset_t extract_stream(ZarHandle* archive, ZarDirCache* dirs, char* members[], size_t count)
+{
+	bool* found = calloc(count ? count : 1, sizeof(bool));
+	if (found == NULL)
+		error(EX_OSERR, "unable to allocate memory");
 
-	ZarOffset_t size;
-	fread(&size, 1, sizeof(size), zar->handle);
-	printf("Size of file map: %lld bytes\n", size);
-	get_string(buffer, sizeof(buffer), zar->handle);
-	printf("Encoding of file map: %s\n", buffer);
-	memset(buffer, 0, sizeof(buffer));
-	printf("File map:\n\n");
-	size_t nbytes = 0;
-	size -= ftell(zar->handle);
-	do {
-		ZarOffset_t offset;
-		nbytes += fread(&offset, 1, sizeof(offset), zar->handle);
-		nbytes += get_string(buffer, sizeof(buffer), zar->handle);
-		printf("\tpath: \"%s\" \toffset: %lld bytes\n", buffer, offset);
-		memset(buffer, 0, sizeof(buffer));
-	} while (nbytes < size);
-	CRC32_t checksum;
-	fread(&checksum, 1, sizeof(checksum), zar->handle);
-	/* TODO: verify checksum. */
-	printf("CRC32 checksum of entire file map: %d\n", checksum);
-	fread(&size, 1, sizeof(size), zar->handle);
-	printf("Offset to first file record: %zd bytes\n", size);
-
-	info("Decoding volume metadata");
-
-	/* App / Version */
-	get_string(buffer, sizeof(buffer), zar->handle);
-	char* app = malloc(strlen(buffer) + 1);
-	if (app == NULL)
-		error(EX_OSERR, "malloc() failed");
-	strcpy(app, buffer);
-	memset(buffer, 0, sizeof(buffer));
-	get_string(buffer, sizeof(buffer), zar->handle);
-	char* ver = malloc(sizeof(strlen(buffer)) + 1);
-	if (ver == NULL)
-		error(EX_OSERR, "malloc() failed");
-	strcpy(ver, buffer);
-	printf("Volume was created by %s version %s\n", app, ver);
-	free(app);
-	free(ver);
+	/* A path recorded again later is simply extracted again, and the last one wins. */
+	ZarOffset_t total = 0;
+	ZarVolumeRecord* volume = zar_create_volume_header();
+	zar_read_volume_record(volume, archive);
+	while (volume != NULL) {
+		total += extract_in_order(volume, archive, dirs, members, count, found);
+		ZarVolumeRecord* next = next_volume(volume, archive);
+		zar_free_volume_header(volume);
+		volume = next;
+	}
 
-DONE:
-	zar_close(zar);
-	return;
+	for (size_t j=0; j < count; ++j) {
+		if (!found[j])
+			error(EX_DATAERR, "%s: not found in archive %s", members[j], archive->path);
+	}
+	free(found);
+	return total;
 }
 
-void zar_extract(const char* archive, const char* where)
+
+void zar_extract(const char* archive, const char* where, char* members[], size_t count)
 {
 	debug("archive: %s", archive);
 	debug("where: %s", where);
 
-	ZarHandle* zar = zar_open(archive);
+	ZarHandle* zar = zar_open(archive, 'r');
 	if (zar == NULL)
 		return;
+	if (zar_tunables.mmap)
+		zar_map(zar);
+
+	/*
+	 * Workers open the archive again, after we've left for where. Standard
+	 * input can't be. The parts of a split archive already have an absolute
+	 * stem to be opened by.
+	 */
+	char* path = NULL;
+	if (strcmp(zar->path, "-") != 0 && zar->nparts == 0) {
+		path = system_realpath(zar->path);
+		if (path == NULL)
+			error(EX_OSERR, "realpath() failed: %s: %s", zar->path, strerror(errno));
+	}
+	bool parallel = zar_tunables.jobs > 1 && (path != NULL || zar->nparts > 0) && !zar->stream;
 
 	if (system_chdir(where) != 0)
 		error(EX_OSERR, "chdir() failed: %s: %s", where, strerror(errno));
 
+	double start = system_clock();
+	ZarOffset_t total = 0;
+	ZarDirCache* dirs = dircache_create();
 
-	ZarVolumeRecord* volume = zar_create_volume_header();
-	zar_read_volume_record(volume, zar);
-	debug("nrecords: %d", volume->nrecords);
-	for (size_t i=0; i < volume->nrecords; ++i) {
-		ZarFileRecord* record = volume->records[i];
-		zar_extract_file(record, zar);
+	/* A stream's volumes are read one at a time, as they go by. */
+	if (!zar->stream)
+		read_volumes(zar);
+
+	/*
+	 * Every directory is made up front from the file maps, once, so
+	 * extracting a record never has to, whichever thread it's on.
+	 */
+	size_t nrecords = 0;
+	for (size_t v=0; v < zar->nvolumes; ++v) {
+		const ZarRecordTable* table = &zar->volumes[v]->records;
+		debug("volume %zu records: %zu", v, table->count);
+		nrecords += table->count;
+		for (size_t i=0; count == 0 && i < table->count; ++i)
+			make_parent_directory(dirs, table->paths[i]);
 	}
 
-	for (size_t i=0; i < volume->nrecords; ++i) {
-	debug("freeing record %d: %s", i, volume->records[i]->path);
-		free(volume->records[i]);
+	if (zar->stream) {
+		/* There's only one way through a stream. */
+		total = extract_stream(zar, dirs, members, count);
+	} else if (count == 0 && parallel) {
+		/*
+		 * Everything, spread over the workers. If a path was recorded more
+		 * than once, only its last record is extracted: that's the one that
+		 * would have won extracting in order.
+		 */
+		ZarOffset_t* offsets = malloc((nrecords ? nrecords : 1) * sizeof(ZarOffset_t));
+		if (offsets == NULL)
+			error(EX_OSERR, "unable to allocate memory");
+		size_t n = 0;
+		for (size_t v=0; v < zar->nvolumes; ++v) {
+			const ZarRecordTable* table = &zar->volumes[v]->records;
+			for (size_t i=0; i < table->count; ++i) {
+				if (table->starts[i] <= 0)
+					error(EX_DATAERR, "%s: no offset for %s in file map", zar->path, table->paths[i]);
+				if (is_current(zar, v, i))
+					offsets[n++] = table->starts[i];
+			}
+		}
+		total = extract_records_parallel(zar, path, offsets, n);
+		free(offsets);
+	} else if (count == 0) {
+		/* Everything: the records of a volume follow one another, so just read on. */
+		ZarFileRecord record;
+		for (size_t v=0; v < zar->nvolumes; ++v) {
+			const ZarRecordTable* table = &zar->volumes[v]->records;
+			archive_seek(zar, zar->volumes[v]->begin);
+			for (size_t i=0; i < table->count; ++i) {
+				init_file_record(&record, table->paths[i]);
+				zar_extract_file(&record, zar);
+				total += record.length;
+			}
+		}
+	} else {
+		/* Look them all up first so a typo doesn't leave a partial extraction. */
+		struct Selection selection;
+		memset(&selection, 0, sizeof(selection));
+		selection.archive = zar;
+		for (size_t i=0; i < count; ++i) {
+			size_t n = 0;
+			for (size_t v=0; v < zar->nvolumes; ++v) {
+				ZarIndex* index = volume_index(zar->volumes[v]);
+				selection.volume = v;
+				if (index_is_pattern(members[i])) {
+					n += index_match(index, members[i], select_row, &selection);
+				} else {
+					size_t row = index_find(index, members[i]);
+					if (row != INDEX_NONE) {
+						select_row(row, &selection);
+						n++;
+					}
+				}
+			}
+			if (n == 0)
+				error(EX_DATAERR, "%s: not found in archive %s", members[i], zar->path);
+		}
+
+		/* The file map tells us where each record is: one seek apiece. */
+		for (size_t i=0; i < selection.count; ++i) {
+			const ZarRecordTable* table = &zar->volumes[selection.volumes[i]]->records;
+			size_t row = selection.rows[i];
+			if (table->starts[row] <= 0)
+				error(EX_DATAERR, "%s: no offset for %s in file map", zar->path, table->paths[row]);
+			make_parent_directory(dirs, table->paths[row]);
+		}
+		if (parallel) {
+			ZarOffset_t* offsets = malloc((selection.count ? selection.count : 1) * sizeof(ZarOffset_t));
+			if (offsets == NULL)
+				error(EX_OSERR, "unable to allocate memory");
+			for (size_t i=0; i < selection.count; ++i)
+				offsets[i] = zar->volumes[selection.volumes[i]]->records.starts[selection.rows[i]];
+			total = extract_records_parallel(zar, path, offsets, selection.count);
+			free(offsets);
+		} else {
+			ZarFileRecord record;
+			for (size_t i=0; i < selection.count; ++i) {
+				const ZarRecordTable* table = &zar->volumes[selection.volumes[i]]->records;
+				size_t row = selection.rows[i];
+				init_file_record(&record, table->paths[row]);
+				archive_seek(zar, table->starts[row]);
+				zar_extract_file(&record, zar);
+				total += record.length;
+			}
+		}
+		free(selection.volumes);
+		free(selection.rows);
 	}
-	free(volume->records);
-	free(volume);
+	report_throughput(zar->path, total, system_clock() - start);
+	debug("%s: made %zu directories", zar->path, dircache_count(dirs));
+
+	dircache_free(dirs);
+	free(path);
 	zar_close(zar);
 }
 
 
-ZarHandle* zar_open(const char* archive)
+ZarHandle* zar_open(const char* archive, char mode)
 {
+	bool create = mode == 'w';
 	debug("%s:%s():%s", __FILE__, __FUNCTION__, archive);
 
 	ZarHandle* r = malloc(sizeof(ZarHandle));
@@ -374,28 +3670,111 @@ ZarHandle* zar_open(const char* archive)
 	r->handle = NULL;
 	r->nvolumes = 0;
 	r->volumes = NULL;
+	r->mapping = NULL;
+	r->mapsize = 0;
+	r->cursor = 0;
+	r->stream = false;
+	r->chunks = NULL;
+	r->block = NULL;
+	r->blockstart = -1;
+	r->blocksize = 0;
+	r->recordpath[0] = '\0';
+	r->nparts = 0;
+	r->part = 0;
+	r->partstarts = NULL;
+	r->base = 0;
+	r->stem = NULL;
+	r->footer = -1;
+	r->footerdata = NULL;
 
 	strncpy(r->path, archive, sizeof(r->path));
 	debug("path:%s", r->path);
-	r->handle = fopen(r->path, "r+b");
-	if (errno == ENOENT && r->handle == NULL) {
+	if (strcmp(r->path, "-") == 0) {
+		r->handle = create ? stdout : stdin;
+		system_binary_mode(r->handle);
+		/* Written archives always stream so they come out the same wherever they go. */
+		r->stream = create || system_seek(r->handle, 0, SEEK_CUR) != 0;
+		debug("%s: using standard %s as a %s", r->path, create ? "output" : "input",
+		      r->stream ? "stream" : "file");
+		return r;
+	}
+
+	if (create && zar_tunables.volume_size > 0) {
+		/* Parts are opened as they're written. See write_parts(). */
+		r->stem = malloc(strlen(archive) + 1);
+		if (r->stem == NULL)
+			error(EX_OSERR, "unable to allocate memory");
+		strcpy(r->stem, archive);
+		return r;
+	}
+	if (!create) {
+		r->stem = split_stem(archive);
+		if (r->stem != NULL) {
+			open_split(r);
+			find_footer(r);
+			return r;
+		}
+	}
+
+	r->handle = fopen(r->path, create ? "w+b" : mode == 'a' ? "r+b" : "rb");
+	if (mode == 'a' && errno == ENOENT && r->handle == NULL) {
 		debug("Archive doesn't exist: creating it.");
 		r->handle = fopen(r->path, "w+b");
 	}
 
+	/* Named pipes and the like. */
+	r->stream = r->handle != NULL && system_seek(r->handle, 0, SEEK_CUR) != 0;
+
 	if (r->handle == NULL) {
 		free(r);
 		error(EX_IOERR, "Failed opening archive %s (%s)", archive, strerror(errno));
 	}
+	if (!create && !r->stream)
+		find_footer(r);
 
 	return r;
 }
 
 
+bool zar_map(ZarHandle* archive)
+{
+	if (archive->stream)
+		return false;
+	if (archive->nparts > 0) {
+		/* Mapping one part at a time would gain nothing on stdio. */
+		debug("%s: split archives aren't memory mapped", archive->path);
+		return false;
+	}
+
+	size_t size = 0;
+	void* p = system_mmap(archive->handle, &size);
+	if (p == NULL) {
+		debug("%s: not memory mapped, falling back to stdio", archive->path);
+		return false;
+	}
+
+	archive->mapping = p;
+	archive->mapsize = (ZarOffset_t)size;
+	archive->cursor = system_tell(archive->handle);
+	debug("%s: mapped %zu bytes", archive->path, size);
+	return true;
+}
+
+
 void zar_close(ZarHandle* archive)
 {
 	debug("Closing archive %s", archive->path);
-	fclose(archive->handle);
+	if (archive->mapping != NULL)
+		system_munmap((void*)archive->mapping, (size_t)archive->mapsize);
+	for (size_t i=0; i < archive->nvolumes; ++i)
+		zar_free_volume_header(archive->volumes[i]);
+	free(archive->volumes);
+	free(archive->block);
+	free(archive->partstarts);
+	free(archive->stem);
+	free(archive->footerdata);
+	if (archive->handle != NULL)
+		fclose(archive->handle);
 	memset(archive->path, 0, sizeof(archive->path));
 	free(archive);
 }
@@ -404,13 +3783,27 @@ void zar_close(ZarHandle* archive)
 ZarVolumeRecord* zar_create_volume_header()
 {
 	ZarVolumeRecord* header = malloc(sizeof(ZarVolumeRecord));
-	header->nrecords = 0;
-	header->records = NULL;
+	table_init(&header->records);
 	header->checksum = 0;
 	header->offset = 0;
+	header->filemap = 0;
+	header->begin = 0;
+	header->end = 0;
+	header->filemapdata = NULL;
+	header->index = NULL;
+	header->streamed = false;
 	return header;
 }
 
+
+void zar_free_volume_header(ZarVolumeRecord* volume)
+{
+	table_free(&volume->records);
+	index_free(volume->index);
+	free(volume->filemapdata);
+	free(volume);
+}
+
 /** Writes the volume record's file map to archive.
  *
  * A file map consists of the following data:
@@ -425,53 +3818,37 @@ ZarVolumeRecord* zar_create_volume_header()
  */
 void zar_write_filemap(ZarVolumeRecord* volume, ZarHandle* archive)
 {
-	xtrace("pos at %s start: %d", __FUNCTION__, ftell(archive->handle));
-
-	/* We don't know the length yet, so B/P to rewind to here and write it.
-	 * And then reuse it to fast forward back again.
-	 * Be mindful of the math when seeking!
-	 */
-	fpos_t mark = mark_position(archive);
+	xtrace("pos at %s start: %lld", __FUNCTION__, (long long)output_tell(archive));
+	volume->filemap = output_tell(archive);
+	const ZarRecordTable* table = &volume->records;
 
-	ZarOffset_t diff = 0;
-	fwrite(&diff, 1, sizeof(diff), archive->handle);
+	/* Add up the length first, so the map is written front to back in one go. */
+	ZarOffset_t length = (ZarOffset_t)sizeof(zar_filemap_encoding);
+	for (size_t i=0; i < table->count; ++i)
+		length += (ZarOffset_t)sizeof(ZarOffset_t) + (ZarOffset_t)strlen(table->paths[i]) + 1;
+	xtrace("file map length: %lld", (long long)length);
+	fwrite(&length, 1, sizeof(length), archive->handle);
 
-	diff = ftell(archive->handle) - sizeof(diff);
-	xtrace("diff marked at %d", diff);
-	/* tpzar only supports UTF-8, and only in as much as the C library does if even that. */
-	static const char* encoding = "utf-8";
-	put_string(encoding, archive->handle);
+	put_string(zar_filemap_encoding, archive->handle);
 
-	/* File map is a simple offset -> path. */
-	for (size_t i=0; i < volume->nrecords; ++i) {
-		debug("write 0'd offset %d bytes long", sizeof(ZarOffset_t));
-		ZarOffset_t offset = 0;
+	/* File map is a simple offset -> path.
+	 *
+	 * Offsets are 0 until the records have been written, at which point
+	 * zar_create() comes back here to write the map again.
+	 */
+	for (size_t i=0; i < table->count; ++i) {
+		ZarOffset_t offset = table->starts[i];
+		debug("write offset %lld", (long long)offset);
 		fwrite(&offset, 1, sizeof(ZarOffset_t), archive->handle);
 
 		debug("write NUL terminated string '%s', %d bytes long",
-		      volume->records[i]->path, strlen(volume->records[i]->path)+1);
-		put_string(volume->records[i]->path, archive->handle);
-	}
-
-	xtrace("pos after map written: %ld", ftell(archive->handle));
-	/* Alright: rewind and write the updated file map length. */
-	diff = ftell(archive->handle) - diff - sizeof(diff);
-	xtrace("diff: %d", diff);
-	xtrace("rewinding from current pos %ld", ftell(archive->handle));
-	if (fsetpos(archive->handle, &mark) != 0)
-		error(EX_IOERR, "%s: failed seeking back to file map offset", archive->path);
-	xtrace("rewound to current pos %ld", ftell(archive->handle));
-	/* Great for testing. */
-	#if 0
-	const char* xxxxxxxx = "XXXXXXXX"; 
-	fwrite(xxxxxxxx , 1, sizeof(diff), archive->handle);
-	#else
-	fwrite(&diff, 1, sizeof(diff), archive->handle);
-	#endif
-	xtrace("wrote updated file map length of %d", diff);
-	if (fseek(archive->handle, (long)diff, SEEK_CUR) != 0)
-		error(EX_IOERR, "%s: failed seeking to end of file map", archive->path);
-	xtrace("fast forwarded current pos %ld", ftell(archive->handle));
+		      table->paths[i], strlen(table->paths[i])+1);
+		put_string(table->paths[i], archive->handle);
+	}
+
+	if (archive->stream)
+		archive->cursor += (ZarOffset_t)sizeof(length) + length;
+	xtrace("pos after map written: %lld", (long long)output_tell(archive));
 }
 
 void zar_write_volume_record(ZarVolumeRecord* volume, ZarHandle* archive)
@@ -481,8 +3858,18 @@ void zar_write_volume_record(ZarVolumeRecord* volume, ZarHandle* archive)
 
 	/* How do we know if we should write start or end mark? */
 	fwrite(&zar_start_mark, 1, 4, archive->handle);
-
-	zar_write_filemap(volume, archive);
+	if (archive->stream)
+		archive->cursor += 4;
+
+	if (volume->streamed) {
+		/* Empty: the file map trails the records. See write_trailer(). */
+		ZarOffset_t none = 0;
+		fwrite(&none, 1, sizeof(none), archive->handle);
+		if (archive->stream)
+			archive->cursor += sizeof(none);
+	} else {
+		zar_write_filemap(volume, archive);
+	}
 
 	fwrite(&volume->checksum, 1, 4, archive->handle);
 	fwrite(&volume->offset, 1, 8, archive->handle);
@@ -495,71 +3882,25 @@ void zar_write_volume_record(ZarVolumeRecord* volume, ZarHandle* archive)
 	const char* myver = "0.1";
 	put_string(myver, archive->handle);
 
+	if (archive->stream)
+		archive->cursor += 4 + 8 + (ZarOffset_t)(strlen(myname) + 1 + strlen(myver) + 1);
+
 	info("Wrote volume created by %s/%s", myname, myver);
 }
 
 void zar_read_volume_record(ZarVolumeRecord* volume, ZarHandle* archive)
 {
-	int32_t start, end;
+	int32_t start;
 
 	debug("Reading volume record from %s", archive);
 
 	debug("zar_start_mark:0x%08x (%d) sizeof %ld", zar_start_mark, zar_start_mark, sizeof(int32_t));
 	debug("zar_end_mark:0x%08x (%d) sizeof %ld", zar_end_mark, zar_end_mark, sizeof(int32_t));
 
-	fread(&start, 1, 4, archive->handle);
+	archive_read(archive, &start, 4);
 	if (start != zar_start_mark)
 		error(EX_DATAERR, "%s: bad volume header.", archive->path);
-
-	/* TODO: decode file map */
-	ZarOffset_t maplength;
-	fread(&maplength, 1, sizeof(ZarOffset_t), archive->handle);
-	debug("%s: file map is %zd bytes long", archive->path, maplength);
-	char encoding[8];
-	get_string(encoding, sizeof(encoding), archive->handle);
-	debug("%s: file map is & paths are encoded as %s", archive->path, encoding);
-
-	long pos = ftell(archive->handle);
-	xtrace("Started reading file map entries at %d", pos);
-	volume->records = NULL;
-	do {
-		ZarOffset_t offset;
-		char path[ZAR_MAX_PATH];
-		fread(&offset, 1, sizeof(offset), archive->handle);
-		get_string(path, sizeof(path), archive->handle);
-		debug("%s: next offset in file map: %d", archive->path, offset);
-		debug("%s: next path in file map: %s", archive->path, path);
-		pos = ftell(archive->handle);
-
-		/*
-		 * There's no indication of how many files are in the map. Assume 1 and
-		 * realloc() as necessary. That way we can stub a record.
-		 */
-		if (volume->records == NULL) {
-			volume->records = malloc(sizeof(ZarFileRecord) * 1);
-		} else {
-			volume->records = realloc(volume->records, sizeof(ZarFileRecord) * (volume->nrecords + 1));
-		}
-		volume->records[volume->nrecords] = zar_create_file_record(path);
-		volume->nrecords += 1;
-	} while(pos < maplength);
-	xtrace("Finished reading file map entries at %d", ftell(archive->handle));
-
-	fread(&volume->checksum, 1, 4, archive->handle);
-	debug("%s: volume checksum: %ld", archive->path, volume->checksum); /* TODO: to string! */
-	fread(&volume->offset, 1, 8, archive->handle);
-	debug("%s: offset to backup volume record %ld", archive->path, volume->offset);
-
-	/* 
-	 * Parse the name and version of what created this volume.
-	 */
-	char app[16], ver[16];
-	get_string(app, sizeof(app), archive->handle);
-	get_string(ver, sizeof(ver), archive->handle);
-	info("volume created by %s/%s", app, ver);
-
-	/* TODO: we might want to verify footer. */
-
+	read_volume_fields(volume, archive);
 }
 
 
@@ -568,16 +3909,8 @@ ZarFileRecord* zar_create_file_record(const char* path)
 	ZarFileRecord* r = malloc(sizeof(ZarFileRecord));
 	if (r == NULL)
 		error(EX_OSERR, errno == ENOMEM ? "No memory." : "Memory allocator failed");
-	strncpy(r->path, path, sizeof(r->path));
+	init_file_record(r, path);
 	debug("created file record for path %s", r->path);
-
-	/* Make sure these fields are initialized rather than left in an undefined state. */
-	r->offset = 0;
-	r->checksum = 0;
-	r->length = 0;
-	r->format[0] = 0xDE;
-	r->format[1] = 0xAD;
-
 	return r;
 }
 
@@ -589,28 +3922,10 @@ ZarFileRecord* zar_create_file_record(const char* path)
  */
 void zar_read_file_record(ZarFileRecord* record, ZarHandle* archive)
 {
-	warn("pos at read offset: %ld", ftell(archive->handle));
-	fread(&record->offset, 1, sizeof(ZarOffset_t), archive->handle);
-	debug("offset to end of record: %ld bytes", record->offset);
+	read_file_record_header(record, archive);
+	archive_seek(archive, archive_tell(archive) + record->length);
 
-	warn("pos at read path: %ld", ftell(archive->handle));
-	/* We're limiting paths to ZAR_MAX_PATH but the format uses NUL termination. */
-	get_string(record->path, sizeof(record->path), archive->handle);
-	debug("read file record path: %s", record->path);
-	if (strlen(record->path) == 0)
-		error(EX_SOFTWARE, "Mysteriously didn't read a string here. %s:%d", __FILE__, __LINE__);
-
-	warn("pos at read format: %ld", ftell(archive->handle));
-	record->format[0] = (char)fgetc(archive->handle);
-	record->format[1] = (char)fgetc(archive->handle);
-	debug("file data format is %c%c", record->format[0], record->format[0]);
-
-	warn("pos at read length: %ld", ftell(archive->handle));
-	fread(&record->length, 1, sizeof(ZarOffset_t), archive->handle);
-	debug("file data is %d bytes long", record->length);
-	fseek(archive->handle, (long)record->length, SEEK_CUR);
-
-	fread(&record->checksum, 1, sizeof(CRC32_t), archive->handle);
+	archive_read(archive, &record->checksum, sizeof(CRC32_t));
 	debug("file record checksum: %lu", record->checksum); /* TODO: to string! */
 
 	/* TODO: make sure current position matches record->offset.
@@ -620,62 +3935,92 @@ void zar_read_file_record(ZarFileRecord* record, ZarHandle* archive)
 }
 
 
-void zar_write_file_record(ZarFileRecord* record, ZarHandle* archive)
-{
-	puts("------------------------------------------------------------------------------------------");
-	fpos_t offset_mark = mark_position(archive);
+/* A record too big to buffer, going straight into the archive. */
+struct UnbufferedRecord {
+	ZarFileRecord* record;
+	ZarHandle* archive;
+	bool started;
+	/* Where the lengths left blank in its header are. */
+	fpos_t offset;
+	fpos_t length;
+};
 
-	xtrace("start of record at %ld bytes", ftell(archive->handle));
-	fwrite("OOOOOOOO", 1, sizeof(ZarOffset_t), archive->handle);
-	xtrace("after offset at start of record at %ld bytes", ftell(archive->handle));
-	record->offset = ftell(archive->handle);
 
-	warn("pos at write path: %ld", ftell(archive->handle));
+/** Overflow for a record's sink: write the record's header, lengths blank. */
+static FILE* start_unbuffered_record(void* context)
+{
+	struct UnbufferedRecord* unbuffered = context;
+	ZarFileRecord* record = unbuffered->record;
+	ZarHandle* archive = unbuffered->archive;
+
+	unbuffered->started = true;
+	unbuffered->offset = mark_position(archive);
+	record->start = output_tell(archive);
+	xtrace("start of unbuffered record at %lld bytes", (long long)record->start);
+	fwrite("OOOOOOOO", 1, sizeof(ZarOffset_t), archive->handle);
 	put_string(record->path, archive->handle);
-
-	/* TODO: How do we want to decide format?
-	 *
-	 * Best plan is probably to make a guess if the file matches a known
-	 * file extension or magic number for a type we know won't compress
-	 * well. And then either store it or apply a minimalist RLE.
-	 *
-	 * If it's just random data other than that: deflate the sucker.
-	 *
-	 * Reserve future XZ support for certain data sets or a "Try harder" option.
-	 */
-	/* For now we just store the data. */
-	record->format[1] = record->format[0] = 0x00;
-
-	warn("pos at write format: %ld", ftell(archive->handle));
 	fputc(record->format[0], archive->handle);
 	fputc(record->format[1], archive->handle);
-
-	fpos_t length_mark = mark_position(archive);
-	warn("pos at write length: %ld", ftell(archive->handle));
+	unbuffered->length = mark_position(archive);
 	fwrite("LLLLLLLL", 1, sizeof(ZarOffset_t), archive->handle);
 
-	record->length = record_raw_file(record, archive);
+	return archive->handle;
+}
+
+
+/** Append a record of the file at record->path.
+ *
+ * Raw data is copied straight in, behind a header giving the file's size.
+ * Anything else is encoded into memory first, so its header can go first too
+ * and the archive is written front to back. Only if it outgrows
+ * zar_tunables.spill_size does it go straight into the archive, and the
+ * lengths in its header get filled in afterwards. A stream can't be, so there
+ * it spills to a temporary file instead.
+ */
+void zar_write_file_record(ZarFileRecord* record, ZarHandle* archive)
+{
+	if (archive->chunks != NULL)
+		memcpy(record->format, zar_format_dedup, sizeof(record->format));
+	else
+		choose_format(record);
+	if (is_format(record, zar_format_raw)) {
+		write_raw_file_record(record, archive);
+		return;
+	}
 
-	fwrite(&record->checksum, 1, sizeof(CRC32_t), archive->handle);
+	struct UnbufferedRecord unbuffered;
+	unbuffered.record = record;
+	unbuffered.archive = archive;
+	unbuffered.started = false;
 
-	xtrace("end of record at %ld bytes", ftell(archive->handle));
+	ZarSink sink;
+	sink_open_memory(&sink, record->path);
+	if (!archive->stream) {
+		sink.overflow = start_unbuffered_record;
+		sink.context = &unbuffered;
+	}
+	encode_file_record(record, &sink, archive);
+	if (!unbuffered.started) {
+		write_encoded_file_record(record, &sink, archive);
+		return;
+	}
+	sink_close(&sink);
+	write_file_record_checksum(record, archive);
+	xtrace("end of record at %lld bytes", (long long)output_tell(archive));
 
-	/* Leap back to update the offset to end of record. */
-	record->offset = ftell(archive->handle) - record->offset;
+	/* Leap back to fill in the offset to end of record, and the length of the data. */
+	record->offset = output_tell(archive) - record->start - (ZarOffset_t)sizeof(ZarOffset_t);
 	fpos_t end_mark = mark_position(archive);
-	if (fsetpos(archive->handle, &offset_mark) != 0)
+	if (fsetpos(archive->handle, &unbuffered.offset) != 0)
 		error(EX_IOERR, "%s: failed seeking back to file record offset", archive->path);
-	debug("offset to next record: %ld", record->offset);
+	debug("offset to next record: %lld", (long long)record->offset);
 	fwrite(&record->offset, 1, sizeof(ZarOffset_t), archive->handle);
 
-	/* And forward to update the length of the compressed data. */
-	if (fsetpos(archive->handle, &length_mark))
+	if (fsetpos(archive->handle, &unbuffered.length) != 0)
 		error(EX_IOERR, "%s: failed seeking back to file data length", archive->path);
-	debug("length of recorded file: %ld", record->length);
+	debug("length of recorded file: %lld", (long long)record->length);
 	fwrite(&record->length, 1, sizeof(ZarOffset_t), archive->handle);
 
-
 	if (fsetpos(archive->handle, &end_mark) != 0)
 		error(EX_IOERR, "%s: failed seeking back to end of record", archive->path);
-	puts("------------------------------------------------------------------------------------------");
 }
@@ -16,42 +16,164 @@
 #ifndef ZAR_SRC_IO__H
 #define ZAR_SRC_IO__H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
 #define ZAR_MAX_PATH 1024
-/* Place holder because we don't do CRC-32 yet. */
+/* CRC-32 with zlib's polynomial, see crc.h. */
 typedef uint32_t CRC32_t;
 typedef int64_t ZarOffset_t;
 
+/** Knobs that tune how archives are read and written.
+ *
+ * Defaults live in io.c. parse_options() overrides them from the command line.
+ */
+struct ZarTunables {
+	/** Size of the buffer used when streaming file data in and out. */
+	size_t block_size;
+
+	/** Compression level for new records, 0-9. 0 stores data raw. */
+	int level;
+
+	/** How new records are compressed, unless they're stored. See codec.h. */
+	const struct ZarCodec_t* codec;
+
+	/** Number of threads encoding records when creating an archive. */
+	size_t jobs;
+
+	/** Read archives through a memory mapping when possible. */
+	bool mmap;
+
+	/** Check extracted raw members against their CRC-32. */
+	bool verify;
+
+	/** Encoded records up to this size are buffered in memory.
+	 *
+	 * That way their header, lengths and all, can be written before them.
+	 * Bigger ones are spilled to temporary files, or written straight into
+	 * an archive that can be patched afterwards.
+	 */
+	size_t spill_size;
+
+	/** Deflate files bigger than this in chunks of this size on jobs threads.
+	 *
+	 * 0 deflates every file as a single stream on one thread.
+	 */
+	size_t chunk_size;
+
+	/** Split file data into content-defined chunks, storing each distinct one once per volume.
+	 *
+	 * Records are written one at a time, however many jobs there are.
+	 */
+	bool dedup;
+
+	/** Deflate runs of small files together, in blocks of up to this many bytes.
+	 *
+	 * Extracting one of them means inflating its block up to it. 0 deflates
+	 * every file on its own. Records are written one at a time, however many
+	 * jobs there are.
+	 */
+	size_t solid_size;
+
+	/** Split archives being created into parts of up to this many bytes.
+	 *
+	 * 0 writes the archive as one file. See ZarHandle::nparts.
+	 */
+	size_t volume_size;
+};
+
+extern struct ZarTunables zar_tunables;
+
 struct ZarVolumeRecord_t;
+struct ZarIndex_t;
+struct ZarChunkIndex_t;
 
 typedef struct {
 	char path[ZAR_MAX_PATH];
 	FILE* handle;
+	/** Header of every volume in the archive, once they've all been read. */
 	size_t nvolumes;
-	struct ZarVolumeRecord_t* volumes;
+	struct ZarVolumeRecord_t** volumes;
+	/** Read only view of the whole archive, or NULL if it isn't mapped. */
+	const unsigned char* mapping;
+	ZarOffset_t mapsize;
+	/** Read position in mapping. handle's position is ignored while mapped.
+	 *
+	 * For a stream, the number of bytes read or written so far.
+	 */
+	ZarOffset_t cursor;
+	/** A pipe, or standard output when creating: never seeked or mapped. */
+	bool stream;
+	/** Chunks stored so far in the volume being written, if deduplicating. */
+	struct ZarChunkIndex_t* chunks;
+	/** The last solid block read through this handle, inflated, or NULL.
+	 *
+	 * blockstart is where the record leading it starts.
+	 */
+	unsigned char* block;
+	ZarOffset_t blockstart;
+	ZarOffset_t blocksize;
+	/** Path from the last record header read through this handle. */
+	char recordpath[ZAR_MAX_PATH];
+	/** Number of files a split archive is in, or 0 if it's all one file.
+	 *
+	 * A split archive is named after stem, in parts numbered stem.001,
+	 * stem.002, and so on, each holding whole volumes. Offsets run on from
+	 * one part to the next as if they'd been concatenated: part k starts at
+	 * partstarts[k], and partstarts[nparts] is where the last one ends.
+	 * handle is the part numbered part, which starts at base. stem is
+	 * absolute when reading, so parts can be opened after changing directory.
+	 */
+	size_t nparts;
+	size_t part;
+	ZarOffset_t* partstarts;
+	ZarOffset_t base;
+	char* stem;
+	/** Where the index at the end of the archive starts, or -1 if there isn't one. */
+	ZarOffset_t footer;
+	/** The index copied out of an unmapped archive, once read. Paths in volumes point into it. */
+	char* footerdata;
 } ZarHandle;
 
 /** Records a file within a ZAR volume. */
 typedef struct ZarFileRecord_t {
+	/** Where this record starts in the archive, as listed in the file map. */
+	ZarOffset_t start;
+
 	/* Offset to the end of this record. */
 	ZarOffset_t offset;
 
 	/** CRC32 Checksum of original file being recorded. */
 	CRC32_t checksum;
 
+	/** CRC32 of the file data as stored in the archive.
+	 *
+	 * Only known while creating. The same as checksum for raw records.
+	 */
+	CRC32_t datasum;
+
 	/** Character representation of how this file is stored.
 	 *
 	 * Standard format codes:
 	 *
-	 *     - "DF" => No compression.
+	 *     - "\0\0" => Raw, no compression.
+	 *     - "DF" => Deflate, without zlib header or trailer.
+	 *     - "CD" => Content-defined chunks, each stored once per volume.
+	 *     - "SB" => Deflated together with the files around it, in a solid block.
+	 *     - "XZ" => An .xz stream without its own check.
+	 *     - "LZ" => Byte aligned LZ77 in blocks, see lz.h.
 	 */
 	char format[2];
 
-	/** Path relative to the root of the archive. */
-	char path[ZAR_MAX_PATH];
+	/** Path relative to the root of the archive.
+	 *
+	 * Not owned by the record: it points at the input list when creating,
+	 * into the file map when reading one, or at the archive's recordpath
+	 * once the record's header has been read.
+	 */
+	const char* path;
 
 	/** Size of the recorded file data. */
 	ZarOffset_t length;
@@ -65,36 +187,102 @@ typedef struct ZarFileRecord_t {
 	/* TODO: whatever. */
 } ZarFileRecord;
 
-typedef struct ZarVolumeRecord_T {
+/** A volume's records, a column apiece, in file map order.
+ *
+ * Scanning one field of every record only touches that field's column. Row i
+ * of every column describes the same record. See table.h.
+ */
+typedef struct {
+	size_t count;
+	size_t capacity;
+	/** Not owned: they point into the file map, or the input list when creating. */
+	const char** paths;
+	/** Where each record starts in the archive. */
+	ZarOffset_t* starts;
+	/** Length of each whole record in bytes, or -1 if unknown. */
+	ZarOffset_t* lengths;
+	/** CRC32 of each record's original file, if known. */
+	CRC32_t* checksums;
+	/** Format of each record's data, or "\xDE\xAD" if unknown. */
+	char (*formats)[2];
+	/** Size of each record's file when it was recorded, or -1 if unknown. */
+	int64_t* sizes;
+	/** Modification time of each record's file when it was recorded, in nanoseconds since the epoch, or -1 if unknown. */
+	int64_t* mtimes;
+} ZarRecordTable;
+
+typedef struct ZarVolumeRecord_t {
 	/* TODO: format version. */
 	/* TODO: tool name. */
 	/* TODO: tool version. */
-	size_t nrecords;
-	ZarFileRecord** records;
-	/* Checksum of all records data. */
+	ZarRecordTable records;
+	/** CRC32 of every byte of the volume's file records, as stored. */
 	CRC32_t checksum;
 	/*
 	 * Number of bytes between end of volume header and start of volume footer.
 	 * I.e. the byte range containing file records.
 	 */
 	ZarOffset_t offset;
+	/** Where this volume's file map starts in the archive. */
+	ZarOffset_t filemap;
+	/** Where this volume's file records start in the archive. */
+	ZarOffset_t begin;
+	/** Where this volume ends, and the next one, if any, starts. */
+	ZarOffset_t end;
+	/** File map copied out of an unmapped archive. Paths in records point into it. */
+	char* filemapdata;
+	/** Lookup from path to row of records, built when first needed. */
+	struct ZarIndex_t* index;
+	/** The file map trails the records, because they were written to a stream.
+	 *
+	 * Reading a stream, records is empty until the reader has got past them.
+	 */
+	bool streamed;
 } ZarVolumeRecord;
 
-/* Probably want to return ZarHandle*? */
+/** Create archive recording files.
+ *
+ * If zar_tunables.volume_size is set, the archive is split into parts of up
+ * to that size, each of them a volume of its own. A part only goes over when
+ * the first file in it is too big on its own.
+ */
 void zar_create(const char* archive, char* files[], size_t count);
+/** Add files to an existing archive as a new volume, leaving the old ones be.
+ *
+ * If update, only files that aren't in the archive yet, or were modified
+ * since it was, are added.
+ */
+void zar_append(const char* archive, char* files[], size_t count, bool update);
 
-void zar_list(const char* archive);
+/** List the members matching names or glob patterns, or everything if count is 0. */
+void zar_list(const char* archive, char* members[], size_t count);
 void zar_info(const char* archive);
-void zar_extract(const char* archive, const char* where);
+/** Check every volume's checksum against its file records, without extracting. */
+void zar_verify(const char* archive);
+/** Extract members matching names or glob patterns, or everything if count is 0. */
+void zar_extract(const char* archive, const char* where, char* members[], size_t count);
 
-ZarHandle* zar_open(const char* archive);
+/** Open archive as fopen() would for mode 'r', 'a' or 'w'.
+ *
+ * 'r' only reads it. 'a' reads it and adds to it, creating it if it doesn't
+ * exist yet. 'w' writes a new one. "-" is standard output for 'w' and
+ * standard input otherwise. An archive that was split is opened by the name
+ * it was created with, or the name of its first part.
+ */
+ZarHandle* zar_open(const char* archive, char mode);
 void zar_close(ZarHandle* archive);
+/** Memory map an archive opened for reading. Returns false if it can't be. */
+bool zar_map(ZarHandle* archive);
 
 ZarVolumeRecord* zar_create_volume_header();
+/** Frees the volume along with its records and index. */
+void zar_free_volume_header(ZarVolumeRecord* volume);
 void zar_read_volume_record(ZarVolumeRecord* volume, ZarHandle* archive);
 void zar_write_volume_record(ZarVolumeRecord* volume, ZarHandle* archive);
+void zar_write_filemap(ZarVolumeRecord* volume, ZarHandle* archive);
 
-ZarFileRecord* zar_create_file_record();
+/** New record for path, which must outlive it: the record only points at it. */
+ZarFileRecord* zar_create_file_record(const char* path);
 void zar_read_file_record(ZarFileRecord* record, ZarHandle* archive);
 void zar_write_file_record(ZarFileRecord* record, ZarHandle* archive);
 
@@ -0,0 +1,261 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "lz.h"
+
+#include <string.h>
+
+
+/* Matches are at least this long, and reach back at most this far. */
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+
+/*
+ * A block always ends in literals: the last match ends at least this far
+ * from the end, and starts at least LZ_MATCH_LIMIT from it. That leaves the
+ * decoder room to copy in wide strides without checking every byte.
+ */
+#define LZ_LAST_LITERALS 5
+#define LZ_MATCH_LIMIT 12
+
+#define LZ_HASH_BITS 12
+
+
+static inline uint32_t read32(const unsigned char* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+
+static inline uint64_t read64(const unsigned char* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+
+static inline uint32_t hash4(uint32_t v)
+{
+	return (v * UINT32_C(2654435761)) >> (32 - LZ_HASH_BITS);
+}
+
+
+/* Index of the lowest byte set in a non-zero little endian word. */
+static inline size_t first_difference(uint64_t diff)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (size_t)__builtin_ctzll(diff) / 8;
+#else
+	size_t n = 0;
+	for (; (diff & 0xff) == 0; diff >>= 8)
+		n++;
+	return n;
+#endif
+}
+
+
+/* How many bytes at a match those at b, not going past limit. b comes before a. */
+static size_t count_common(const unsigned char* a, const unsigned char* b, const unsigned char* limit)
+{
+	const unsigned char* start = a;
+	while (a + 8 <= limit) {
+		uint64_t diff = read64(a) ^ read64(b);
+		if (diff != 0)
+			return (size_t)(a - start) + first_difference(diff);
+		a += 8;
+		b += 8;
+	}
+	while (a < limit && *a == *b) {
+		a++;
+		b++;
+	}
+	return (size_t)(a - start);
+}
+
+
+/* The part of a length past what fits in its half of the token: 255s, then the rest. */
+static unsigned char* put_length(unsigned char* op, size_t n)
+{
+	for (; n >= 255; n -= 255)
+		*op++ = 255;
+	*op++ = (unsigned char)n;
+	return op;
+}
+
+
+/* A run of literals, then a match unless length is 0, which only the last one lacks. */
+static unsigned char* put_sequence(unsigned char* op, const unsigned char* literals, size_t nliterals,
+                                   size_t offset, size_t length)
+{
+	unsigned char* token = op++;
+	*token = (unsigned char)((nliterals < 15 ? nliterals : 15) << 4);
+	if (nliterals >= 15)
+		op = put_length(op, nliterals - 15);
+	memcpy(op, literals, nliterals);
+	op += nliterals;
+	if (length == 0)
+		return op;
+
+	*op++ = (unsigned char)(offset & 0xff);
+	*op++ = (unsigned char)(offset >> 8);
+	length -= LZ_MIN_MATCH;
+	*token |= (unsigned char)(length < 15 ? length : 15);
+	if (length >= 15)
+		op = put_length(op, length - 15);
+	return op;
+}
+
+
+size_t lz_compress(const unsigned char* src, size_t n, unsigned char* dst, uint32_t* table)
+{
+	unsigned char* op = dst;
+	size_t anchor = 0;
+
+	if (n >= LZ_MATCH_LIMIT) {
+		size_t limit = n - LZ_MATCH_LIMIT;
+		const unsigned char* matchend = src + n - LZ_LAST_LITERALS;
+		size_t ip = 0;
+		while (ip <= limit) {
+			uint32_t h = hash4(read32(src + ip));
+			size_t candidate = table[h];
+			table[h] = (uint32_t)ip;
+			/* Entries left over from another block get checked like any other. */
+			if (candidate >= ip || ip - candidate > LZ_MAX_OFFSET
+			    || read32(src + candidate) != read32(src + ip)) {
+				/* The longer since the last match, the bigger the strides. */
+				ip += 1 + ((ip - anchor) >> 6);
+				continue;
+			}
+
+			while (ip > anchor && candidate > 0 && src[ip - 1] == src[candidate - 1]) {
+				ip--;
+				candidate--;
+			}
+			size_t length = LZ_MIN_MATCH
+			              + count_common(src + ip + LZ_MIN_MATCH, src + candidate + LZ_MIN_MATCH, matchend);
+			op = put_sequence(op, src + anchor, ip - anchor, ip - candidate, length);
+			ip += length;
+			anchor = ip;
+			if (ip <= limit)
+				table[hash4(read32(src + ip - 2))] = (uint32_t)(ip - 2);
+		}
+	}
+
+	op = put_sequence(op, src + anchor, n - anchor, 0, 0);
+	return (size_t)(op - dst);
+}
+
+
+/* Add the 255s and the rest that follow a full half of the token onto *length. */
+static bool get_length(const unsigned char** ip, const unsigned char* iend, size_t* length)
+{
+	unsigned char b;
+	do {
+		if (*ip == iend)
+			return false;
+		b = *(*ip)++;
+		*length += b;
+	} while (b == 255);
+	return true;
+}
+
+
+bool lz_decompress(const unsigned char* src, size_t n, unsigned char* dst, size_t size)
+{
+	const unsigned char* ip = src;
+	const unsigned char* iend = src + n;
+	unsigned char* op = dst;
+	unsigned char* oend = dst + size;
+
+	for (;;) {
+		if (ip == iend)
+			return false;
+		unsigned token = *ip++;
+
+		/*
+		 * Most sequences are a few literals and a short match not too near the
+		 * end of either block: one 16 byte copy apiece does for those.
+		 */
+		if (token < 0xf0 && (token & 15) != 15 && iend - ip >= 32 && oend - op >= 32) {
+			size_t literals = token >> 4;
+			memcpy(op, ip, 16);
+			ip += literals;
+			op += literals;
+			size_t offset = ip[0] | (size_t)ip[1] << 8;
+			ip += 2;
+			if (offset >= 16 && offset <= (size_t)(op - dst)) {
+				const unsigned char* match = op - offset;
+				memcpy(op, match, 16);
+				memcpy(op + 16, match + 16, 2);
+				op += (token & 15) + LZ_MIN_MATCH;
+				continue;
+			}
+			/* Back up and take the long way. */
+			ip -= literals + 2;
+			op -= literals;
+		}
+
+		size_t literals = token >> 4;
+		if (literals == 15 && !get_length(&ip, iend, &literals))
+			return false;
+		if (literals > (size_t)(iend - ip) || literals > (size_t)(oend - op))
+			return false;
+		/* Short runs are the common case: one wide copy, if there's room to overshoot. */
+		if (literals <= 16 && iend - ip >= 16 && oend - op >= 16)
+			memcpy(op, ip, 16);
+		else
+			memcpy(op, ip, literals);
+		ip += literals;
+		op += literals;
+		if (ip == iend)
+			return op == oend;
+
+		if (iend - ip < 2)
+			return false;
+		size_t offset = ip[0] | (size_t)ip[1] << 8;
+		ip += 2;
+		size_t length = token & 15;
+		if (length == 15 && !get_length(&ip, iend, &length))
+			return false;
+		length += LZ_MIN_MATCH;
+		if (offset == 0 || offset > (size_t)(op - dst) || length > (size_t)(oend - op))
+			return false;
+
+		/*
+		 * Copy in strides no longer than the offset, so each one reads only
+		 * what's already been written, overshooting the end by less than a
+		 * stride when there's room for it.
+		 */
+		const unsigned char* match = op - offset;
+		size_t room = (size_t)(oend - op);
+		if (offset >= 16 && room >= length + 16) {
+			for (size_t i = 0; i < length; i += 16)
+				memcpy(op + i, match + i, 16);
+		} else if (offset >= 8 && room >= length + 8) {
+			for (size_t i = 0; i < length; i += 8)
+				memcpy(op + i, match + i, 8);
+		} else if (offset == 1) {
+			memset(op, *match, length);
+		} else {
+			for (size_t i = 0; i < length; i++)
+				op[i] = match[i];
+		}
+		op += length;
+	}
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZAR_SRC_LZ__H
+#define ZAR_SRC_LZ__H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A byte aligned LZ77 in the manner of LZ4: runs of literals and matches of
+ * at least 4 bytes up to 64K back, with no entropy coding. It squeezes less
+ * out than deflate, but decodes several times faster.
+ */
+
+/** Most a block of n bytes can grow to. */
+#define LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+/** Entries in the hash table lz_compress() remembers positions in. */
+#define LZ_HASH_SIZE 4096
+
+/** Compress n bytes of src into dst, which must have room for LZ_BOUND(n).
+ *
+ * table has LZ_HASH_SIZE entries and is only a cache: it needn't be cleared
+ * between blocks, only zeroed before the first. Returns the compressed length.
+ */
+size_t lz_compress(const unsigned char* src, size_t n, unsigned char* dst, uint32_t* table);
+
+/** Decompress n bytes of src, which must come to exactly size bytes at dst.
+ *
+ * Returns false if src is corrupt. Never reads or writes outside either block.
+ */
+bool lz_decompress(const unsigned char* src, size_t n, unsigned char* dst, size_t size);
+
+#endif
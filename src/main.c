@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include "chunk.h"
+#include "crc.h"
 #include "options.h"
 #include "io.h"
 
@@ -24,18 +26,26 @@ int main(int argc, char* argv[])
 	--argc;
 	++argv;
 	struct ZarOptions options = parse_options(argc, argv);
+	crc_init();
+	chunk_init();
 	if (options.mode == 'c') {
 		/* Let's create us an archive, zaaarrrr! */
 		zar_create(options.zarfile, options.inputs, options.ninputs);
 	}
+	else if (options.mode == 'r' || options.mode == 'u') {
+		zar_append(options.zarfile, options.inputs, options.ninputs, options.mode == 'u');
+	}
 	else if (options.mode == 't') {
-		zar_list(options.zarfile);
+		zar_list(options.zarfile, options.inputs, options.ninputs);
 	}
 	else if (options.mode == 'i') {
 		zar_info(options.zarfile);
 	}
+	else if (options.mode == 'V') {
+		zar_verify(options.zarfile);
+	}
 	else if (options.mode == 'x') {
-		zar_extract(options.zarfile, options.dir);
+		zar_extract(options.zarfile, options.dir, options.inputs, options.ninputs);
 	}
 	return 0;
 }
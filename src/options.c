@@ -14,18 +14,18 @@
  * limitations under the License.
  */
 
+#include "codec.h"
 #include "debug.h"
+#include "io.h"
 #include "options.h"
 #include "sysexits.h"
 #include "system.h"
+#include "walk.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-/* TODO: move to shared header... */
-#define ZAR_MAX_PATH 1024
-
 extern int debug_level;
 
 void usage_short()
@@ -38,17 +38,32 @@ void usage_short()
 void usage_long()
 {
 	puts("usage: zar [options] {zarfile} [input files]");
+	puts("       zar -x [options] {zarfile} [members]");
 	putchar('\n');
 	puts("\t-h,                        \tshort help.");
 	puts("\t--help,                    \tlong help.");
 	puts("\t-c, --create,              \tcreate an archive.");
+	puts("\t-r, --append,              \tadd files to an archive.");
+	puts("\t-u, --update,              \tadd files that changed since they were archived.");
 	puts("\t-t, --list,                \tlist archive members.");
 	puts("\t-i, --info,                \tinfo about archive.");
 	puts("\t-x, --extract,             \tlist archive members.");
+	puts("\t--verify,                  \tcheck archive checksums.");
 	puts("\t-C DIR, --directory DIR    \twhere to extract archive.");
-	puts("\t-f FILE, --file FILE,      \tspecify ZAR archive file.");
+	puts("\t-f FILE, --file FILE,      \tspecify ZAR archive file. - pipes it.");
 	puts("\t-v, --verbose,             \tchitty, chatty two shoes.");
 	puts("\t-D NUM, --debug-level NUM  \tSet debug level.");
+	puts("\t--block-size SIZE          \tI/O buffer size, e.g. 64K or 4M.");
+	puts("\t--level NUM                \tcompression level 0-9. 0 stores.");
+	puts("\t--codec NAME               \tcompress with deflate, xz, lz or raw.");
+	puts("\t-j NUM, --jobs NUM         \tthreads to use. 0 for one per CPU.");
+	puts("\t--chunk-size SIZE          \tdeflate bigger files in parallel chunks.");
+	puts("\t--spill-size SIZE          \tbuffer records up to SIZE in memory.");
+	puts("\t--solid SIZE               \tdeflate small files together in SIZE blocks.");
+	puts("\t--dedup                    \tstore repeated chunks of data once.");
+	puts("\t--volume-size SIZE         \tsplit the archive into parts of up to SIZE.");
+	puts("\t--mmap                     \tread archives through a memory map.");
+	puts("\t--no-verify                \tskip checksums of raw members on extract.");
 	exit(64);
 }
 
@@ -60,64 +75,46 @@ static inline bool is_option(const char* option, const char* argument)
 }
 
 
-static inline void append_to_inputs(struct ZarOptions* opts, const char* path, size_t* index)
+/** Parses a size like 4096, 64K, 4M, or 1G into bytes.
+ *
+ * Calls error() if str isn't a positive size.
+ */
+static size_t parse_size(const char* option, const char* str)
 {
-	info("Adding %s to input list at index %d", path, *index);
-
-	opts->ninputs += 1;
+	if (str == NULL)
+		error(EX_USAGE, "%s: missing size.", option);
+
+	char* end = NULL;
+	unsigned long long n = strtoull(str, &end, 10);
+	switch (*end) {
+		case 'g': case 'G':
+			n *= 1024;
+			/* fall through */
+		case 'm': case 'M':
+			n *= 1024;
+			/* fall through */
+		case 'k': case 'K':
+			n *= 1024;
+			++end;
+			break;
+	}
+	if (end == str || *end != '\0' || n == 0)
+		error(EX_USAGE, "%s: invalid size: %s", option, str);
 
-	opts->inputs = realloc(opts->inputs, ZAR_MAX_PATH * opts->ninputs);
-	if (opts->inputs == NULL)
-		error(EX_OSERR, "Unable to allocate memory");
+	return (size_t)n;
+}
 
-	char* p = opts->inputs[*index] = malloc(ZAR_MAX_PATH);
-	if (p == NULL)
-		error(EX_OSERR, "Unable to allocate memory for %s", path);
-	memset(p, '\0', ZAR_MAX_PATH);
-	strncpy(p, path, strlen(path) + 1);
 
-	*index += 1;
+static inline void append_to_inputs(struct ZarOptions* opts, const char* path)
+{
+	info("Adding %s to input list at index %zu", path, opts->paths.count);
+	arena_add(&opts->paths, path);
 }
 
 
-static inline void foo(struct ZarOptions* opts, const char* root, size_t* index)
+static void add_walked_input(void* context, const char* path)
 {
-	info("Adding %s to input list (recursively)", root);
-	if (*index > 30)
-		error(1, "FORCE EXIT");
-
-	void* dir = system_opendir(root);
-	char* entry;
-	char buffer[ZAR_MAX_PATH];
-
-	memset(buffer, '\0', ZAR_MAX_PATH);
-	while ((entry = system_readdir(dir, buffer, sizeof(buffer))) != NULL) {
-		debug("entry/buffer: %s", buffer);
-
-		char path[ZAR_MAX_PATH];
-
-		xtrace("Combing root and system_readdir() entry into one path.");
-		size_t sep = strlen(root);
-		strncpy(path, root, ZAR_MAX_PATH);
-		path[sep] = '/';
-		char* p = path + sep + 1;
-		strncpy(p, entry, ZAR_MAX_PATH - strlen(path));
-		xtrace("Combined path: %s", path);
-
-		#if 0
-		append_to_inputs(opts, path, index);
-		#else
-		void* child = system_opendir(path);
-		if (child == NULL) {
-			append_to_inputs(opts, path, index);
-		} else {
-			system_closedir(child);
-			foo(opts, path, index);
-		}
-		#endif
-	}
-
-	system_closedir(dir);
+	append_to_inputs(context, path);
 }
 
 
@@ -131,6 +128,7 @@ struct ZarOptions parse_options(int argc, char* argv[])
 	opts.dir = system_getcwd(NULL, 0);
 	opts.inputs = NULL;
 	opts.mode = '\0';
+	opts.verbose = false;
 
 	for (i=0; i < argc; ++i) {
 		const char* arg = argv[i];
@@ -163,6 +161,12 @@ struct ZarOptions parse_options(int argc, char* argv[])
 		else if (is_option("-c", arg) || is_option("--create", arg)) {
 			opts.mode = 'c';
 		}
+		else if (is_option("-r", arg) || is_option("--append", arg)) {
+			opts.mode = 'r';
+		}
+		else if (is_option("-u", arg) || is_option("--update", arg)) {
+			opts.mode = 'u';
+		}
 		else if (is_option("-x", arg) || is_option("--extract", arg)) {
 			opts.mode = 'x';
 		}
@@ -172,15 +176,72 @@ struct ZarOptions parse_options(int argc, char* argv[])
 		else if (is_option("-i", arg) || is_option("--info", arg)) {
 			opts.mode = 'i';
 		}
+		else if (is_option("--verify", arg)) {
+			opts.mode = 'V';
+		}
 		else if (is_option("-C", arg) || is_option("--directory", arg)) {
 			i++;
 			opts.dir = argv[i];
 		}
+		else if (is_option("--block-size", arg)) {
+			i++;
+			zar_tunables.block_size = parse_size(arg, argv[i]);
+		}
+		else if (is_option("-j", arg) || is_option("--jobs", arg)) {
+			i++;
+			char* end = NULL;
+			long n = argv[i] == NULL ? -1 : strtol(argv[i], &end, 10);
+			if (n < 0 || end == argv[i] || *end != '\0')
+				error(EX_USAGE, "%s: expected a number of jobs.", arg);
+			zar_tunables.jobs = n == 0 ? system_ncpus() : (size_t)n;
+		}
+		else if (is_option("--chunk-size", arg)) {
+			i++;
+			zar_tunables.chunk_size = parse_size(arg, argv[i]);
+		}
+		else if (is_option("--spill-size", arg)) {
+			i++;
+			zar_tunables.spill_size = parse_size(arg, argv[i]);
+		}
+		else if (is_option("--solid", arg)) {
+			i++;
+			zar_tunables.solid_size = parse_size(arg, argv[i]);
+		}
+		else if (is_option("--volume-size", arg)) {
+			i++;
+			zar_tunables.volume_size = parse_size(arg, argv[i]);
+		}
+		else if (is_option("--dedup", arg)) {
+			zar_tunables.dedup = true;
+		}
+		else if (is_option("--mmap", arg)) {
+			zar_tunables.mmap = true;
+		}
+		else if (is_option("--no-verify", arg)) {
+			zar_tunables.verify = false;
+		}
+		else if (is_option("--codec", arg)) {
+			i++;
+			zar_tunables.codec = argv[i] == NULL ? NULL : codec_named(argv[i]);
+			if (zar_tunables.codec == NULL)
+				error(EX_USAGE, "%s: expected deflate, xz, lz or raw.", arg);
+		}
+		else if (is_option("--level", arg)) {
+			i++;
+			if (argv[i] == NULL || argv[i][0] < '0' || argv[i][0] > '9' || argv[i][1] != '\0')
+				error(EX_USAGE, "%s: expected a level from 0 to 9.", arg);
+			zar_tunables.level = argv[i][0] - '0';
+		}
 		else {
 			printf("unrecognized option: %s\n", arg);
 			usage_short();
 		}
 	}
+	/* Solid blocks and chunks are deflated, or stored as they are with --codec raw. */
+	const ZarCodec* codec = zar_tunables.codec;
+	if (codec != &codec_deflate && codec != &codec_raw && (zar_tunables.solid_size > 0 || zar_tunables.dedup))
+		error(EX_USAGE, "--codec %s: --solid and --dedup only deflate.", codec->name);
+
 	argv += i;
 	argc -= i;
 	for (i=0; i < argc; ++i)
@@ -189,34 +250,44 @@ struct ZarOptions parse_options(int argc, char* argv[])
 
 	debug("number of inputs on command line:%d", argc);
 
-	/* Just a stub. */
-	opts.inputs = malloc(1);
-	if (opts.inputs == NULL)
-		error(EX_OSERR, "Unable to allocate any memory");
+	/* Unless adding to an archive, these name archive members, not local files. */
+	bool adding = opts.mode == 'c' || opts.mode == 'r' || opts.mode == 'u';
 
 	/*
 	 * Add the files first, 'cuz easy peasy.
 	 */
-	opts.ninputs = 0;
-	size_t index = 0;
+	arena_init(&opts.paths);
 	for (int j=0; j < argc; ++j) {
 		const char* path = system_fix_pathseps(argv[j]);
-		if (system_isdir(path))
+		if (adding && system_isdir(path))
 			continue;
-		append_to_inputs(&opts, path, &index);
+		append_to_inputs(&opts, path);
 	}
-	debug("index now: %d", index);
+	debug("index now: %zu", opts.paths.count);
 
 	/*
-	 * Second pass for the directories.
+	 * Second pass for the directories, all walked together.
 	 */
-	for (int j=0; j < argc; ++j) {
-		const char* path = system_fix_pathseps(argv[j]);
-		if (!system_isdir(path))
-			continue;
-		foo(&opts, path, &index);
+	char** roots = malloc((argc ? argc : 1) * sizeof(char*));
+	if (roots == NULL)
+		error(EX_OSERR, "Unable to allocate memory");
+	size_t nroots = 0;
+	for (int j=0; adding && j < argc; ++j) {
+		char* path = system_fix_pathseps(argv[j]);
+		if (system_isdir(path))
+			roots[nroots++] = path;
 	}
-	debug("index now: %d", index);
+	walk_directories(roots, nroots, zar_tunables.jobs, add_walked_input, &opts);
+	free(roots);
+	debug("index now: %zu", opts.paths.count);
+
+	/* Nothing more gets added, so the arena won't move: point into it. */
+	opts.ninputs = opts.paths.count;
+	opts.inputs = malloc((opts.ninputs ? opts.ninputs : 1) * sizeof(char*));
+	if (opts.inputs == NULL)
+		error(EX_OSERR, "Unable to allocate memory");
+	for (size_t j=0; j < opts.ninputs; ++j)
+		opts.inputs[j] = (char*)arena_get(&opts.paths, j);
 
 	debug("ZarOptions::zarfile:%s", opts.zarfile);
 	debug("ZarOptions::mode: %c", opts.mode);
@@ -17,6 +17,8 @@
 #ifndef ZAR_SRC_OPTIONS__H
 #define ZAR_SRC_OPTIONS__H
 
+#include "arena.h"
+
 #include <stddef.h>
 #include <stdbool.h>
 
@@ -24,9 +26,13 @@ struct ZarOptions {
 	const char* zarfile;
 	const char* dir;
 	size_t ninputs;
+	/** Point into paths, which holds the strings. */
 	char** inputs;
+	ZarArena paths;
 	/*
 	 * c == create new archive from inputs.
+	 * r == append inputs to archive as a new volume.
+	 * u == like r, but only inputs new or modified since the archive was.
 	 * x == extract specified archive.
 	 * t == list contents of archive.
 	 * i == info about archive.
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pool.h"
+
+#include "debug.h"
+#include "sysexits.h"
+#include "system.h"
+
+#include <stdlib.h>
+
+
+struct ZarPool_t {
+	void* mutex;
+	/* Broadcast whenever a job finishes or jobs are released. */
+	void* cond;
+
+	size_t nthreads;
+	void** threads;
+
+	ZarPoolJob job;
+	void* context;
+
+	size_t njobs;
+	/* Index of the next job a worker will pick up. */
+	size_t next;
+	/* Jobs before this index have been released by the consumer. */
+	size_t released;
+	size_t window;
+	bool* done;
+};
+
+
+static void worker(void* arg)
+{
+	ZarPool* pool = arg;
+
+	system_mutex_lock(pool->mutex);
+	for (;;) {
+		while (pool->next < pool->njobs && pool->next >= pool->released + pool->window)
+			system_cond_wait(pool->cond, pool->mutex);
+		if (pool->next >= pool->njobs)
+			break;
+
+		size_t index = pool->next++;
+		system_mutex_unlock(pool->mutex);
+
+		xtrace("pool: running job %zu", index);
+		pool->job(pool->context, index);
+
+		system_mutex_lock(pool->mutex);
+		pool->done[index] = true;
+		system_cond_broadcast(pool->cond);
+	}
+	system_mutex_unlock(pool->mutex);
+}
+
+
+ZarPool* pool_start(size_t nthreads, size_t njobs, size_t window,
+                    ZarPoolJob job, void* context)
+{
+	ZarPool* pool = malloc(sizeof(ZarPool));
+	if (pool == NULL)
+		error(EX_OSERR, "%s(): unable allocate memory.", __func__);
+
+	if (nthreads == 0)
+		nthreads = 1;
+	if (nthreads > njobs && njobs > 0)
+		nthreads = njobs;
+
+	pool->mutex = system_mutex_create();
+	pool->cond = system_cond_create();
+	pool->job = job;
+	pool->context = context;
+	pool->njobs = njobs;
+	pool->next = 0;
+	pool->released = 0;
+	pool->window = window == 0 ? njobs : window;
+	pool->done = calloc(njobs + 1, sizeof(bool));
+	pool->nthreads = nthreads;
+	pool->threads = malloc(nthreads * sizeof(void*));
+	if (pool->done == NULL || pool->threads == NULL)
+		error(EX_OSERR, "%s(): unable allocate memory.", __func__);
+
+	debug("pool: starting %zu threads for %zu jobs", nthreads, njobs);
+	for (size_t i=0; i < nthreads; ++i)
+		pool->threads[i] = system_thread_start(worker, pool);
+
+	return pool;
+}
+
+
+void pool_wait(ZarPool* pool, size_t index)
+{
+	system_mutex_lock(pool->mutex);
+	while (!pool->done[index])
+		system_cond_wait(pool->cond, pool->mutex);
+	system_mutex_unlock(pool->mutex);
+}
+
+
+void pool_release(ZarPool* pool, size_t index)
+{
+	system_mutex_lock(pool->mutex);
+	if (index + 1 > pool->released) {
+		pool->released = index + 1;
+		system_cond_broadcast(pool->cond);
+	}
+	system_mutex_unlock(pool->mutex);
+}
+
+
+void pool_cancel(ZarPool* pool)
+{
+	system_mutex_lock(pool->mutex);
+	debug("pool: cancelling %zu jobs not started yet", pool->njobs - pool->next);
+	pool->njobs = pool->next;
+	system_cond_broadcast(pool->cond);
+	system_mutex_unlock(pool->mutex);
+}
+
+
+void pool_finish(ZarPool* pool)
+{
+	/* Nobody is going to release anything else, so let the workers drain. */
+	pool_release(pool, pool->njobs);
+
+	for (size_t i=0; i < pool->nthreads; ++i)
+		system_thread_join(pool->threads[i]);
+
+	system_cond_destroy(pool->cond);
+	system_mutex_destroy(pool->mutex);
+	free(pool->threads);
+	free(pool->done);
+	free(pool);
+}
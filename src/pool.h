@@ -0,0 +1,53 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZAR_SRC_POOL__H
+#define ZAR_SRC_POOL__H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Runs numbered jobs on a set of worker threads.
+ *
+ * Jobs are started in index order. A consumer that needs results in order can
+ * pool_wait() for each index, use its results, and pool_release() it. Workers
+ * never start a job more than window indexes past the oldest unreleased one,
+ * which bounds how many results are held in memory at once.
+ */
+typedef struct ZarPool_t ZarPool;
+
+/** Called on a worker thread to run job number index. */
+typedef void (*ZarPoolJob)(void* context, size_t index);
+
+/** Starts nthreads workers to run jobs 0 through njobs - 1.
+ *
+ * A window of 0 means workers may run arbitrarily far ahead.
+ */
+ZarPool* pool_start(size_t nthreads, size_t njobs, size_t window,
+                    ZarPoolJob job, void* context);
+
+/** Blocks until job index has finished running. */
+void pool_wait(ZarPool* pool, size_t index);
+
+/** Marks every job up to and including index as consumed. */
+void pool_release(ZarPool* pool, size_t index);
+
+/** Stops workers starting any more jobs. Those already running still finish. */
+void pool_cancel(ZarPool* pool);
+
+/** Waits for all jobs to finish, joins the workers, and frees pool. */
+void pool_finish(ZarPool* pool);
+
+#endif
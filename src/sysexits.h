@@ -20,6 +20,7 @@
  * Based on FreeBSD's sysexits.h.
  */
 
+#define EX_USAGE	64 /* Command line usage error. */
 #define EX_DATAERR	65 /* Input data incorrect. */
 #define EX_IOERR	74 /* File I/O error. */
 #define EX_OSERR	71 /* OS error like can't fork(). */
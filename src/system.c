@@ -14,6 +14,15 @@
  * limitations under the License.
  */
 
+#ifdef __linux__
+/* For copy_file_range(). */
+#define _GNU_SOURCE
+#endif
+#ifndef _WIN32
+/* So off_t, and with it fseeko() and ftello(), is 64 bits on 32-bit systems too. */
+#define _FILE_OFFSET_BITS 64
+#endif
+
 #include "debug.h"
 #include "io.h"
 #include "sysexits.h"
@@ -30,16 +39,25 @@
 #include <FileAPI.h>
 #define stat(path, buffer) _stat(path, buffer)
 #define S_ISDIR(mode) (mode & _S_IFDIR)
+#include <fcntl.h>
+#include <io.h>
 #else
 #include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #endif
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 char* system_getcwd(char* out, size_t size)
 {
@@ -68,6 +86,12 @@ static int wrapped_mkdir(const char* path)
 }
 
 
+int system_mkdir_one(const char* path)
+{
+	return wrapped_mkdir(path);
+}
+
+
 int system_mkdir(const char* path)
 {
 	const char* seg = NULL;
@@ -94,6 +118,16 @@ int system_mkdir(const char* path)
 }
 
 
+char* system_realpath(const char* path)
+{
+#ifdef _WIN32
+	return _fullpath(NULL, path, 0);
+#else
+	return realpath(path, NULL);
+#endif
+}
+
+
 char* system_dirname(const char* path)
 {
 	static const char* def = ".";
@@ -167,6 +201,338 @@ char* system_fix_pathseps(char* path)
 }
 
 
+double system_clock(void)
+{
+#if _WIN32
+	LARGE_INTEGER frequency, now;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&now);
+	return (double)now.QuadPart / (double)frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+#endif
+}
+
+
+size_t system_ncpus(void)
+{
+#if _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (size_t)info.dwNumberOfProcessors : 1;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (size_t)n : 1;
+#endif
+}
+
+
+/* What the native thread entry point needs to call our entry point. */
+struct ThreadStart {
+	void (*func)(void* arg);
+	void* arg;
+};
+
+
+#if _WIN32
+static DWORD WINAPI thread_main(LPVOID p)
+#else
+static void* thread_main(void* p)
+#endif
+{
+	struct ThreadStart start = *(struct ThreadStart*)p;
+	free(p);
+	start.func(start.arg);
+	return 0;
+}
+
+
+void* system_thread_start(void (*func)(void* arg), void* arg)
+{
+	struct ThreadStart* start = malloc(sizeof(struct ThreadStart));
+	if (start == NULL)
+		error(EX_OSERR, "%s(): unable allocate memory.", __func__);
+	start->func = func;
+	start->arg = arg;
+#if _WIN32
+	HANDLE thread = CreateThread(NULL, 0, thread_main, start, 0, NULL);
+	if (thread == NULL)
+		error(EX_OSERR, "CreateThread() failed: %lu", (unsigned long)GetLastError());
+	return thread;
+#else
+	pthread_t* thread = malloc(sizeof(pthread_t));
+	if (thread == NULL)
+		error(EX_OSERR, "%s(): unable allocate memory.", __func__);
+	int status = pthread_create(thread, NULL, thread_main, start);
+	if (status != 0)
+		error(EX_OSERR, "pthread_create() failed: %s", strerror(status));
+	return thread;
+#endif
+}
+
+
+void system_thread_join(void* thread)
+{
+#if _WIN32
+	WaitForSingleObject((HANDLE)thread, INFINITE);
+	CloseHandle((HANDLE)thread);
+#else
+	pthread_join(*(pthread_t*)thread, NULL);
+	free(thread);
+#endif
+}
+
+
+void* system_mutex_create(void)
+{
+#if _WIN32
+	SRWLOCK* mutex = malloc(sizeof(SRWLOCK));
+	if (mutex == NULL)
+		error(EX_OSERR, "%s(): unable allocate memory.", __func__);
+	InitializeSRWLock(mutex);
+#else
+	pthread_mutex_t* mutex = malloc(sizeof(pthread_mutex_t));
+	if (mutex == NULL)
+		error(EX_OSERR, "%s(): unable allocate memory.", __func__);
+	pthread_mutex_init(mutex, NULL);
+#endif
+	return mutex;
+}
+
+
+void system_mutex_lock(void* mutex)
+{
+#if _WIN32
+	AcquireSRWLockExclusive((SRWLOCK*)mutex);
+#else
+	pthread_mutex_lock((pthread_mutex_t*)mutex);
+#endif
+}
+
+
+void system_mutex_unlock(void* mutex)
+{
+#if _WIN32
+	ReleaseSRWLockExclusive((SRWLOCK*)mutex);
+#else
+	pthread_mutex_unlock((pthread_mutex_t*)mutex);
+#endif
+}
+
+
+void system_mutex_destroy(void* mutex)
+{
+#if !_WIN32
+	pthread_mutex_destroy((pthread_mutex_t*)mutex);
+#endif
+	free(mutex);
+}
+
+
+void* system_cond_create(void)
+{
+#if _WIN32
+	CONDITION_VARIABLE* cond = malloc(sizeof(CONDITION_VARIABLE));
+	if (cond == NULL)
+		error(EX_OSERR, "%s(): unable allocate memory.", __func__);
+	InitializeConditionVariable(cond);
+#else
+	pthread_cond_t* cond = malloc(sizeof(pthread_cond_t));
+	if (cond == NULL)
+		error(EX_OSERR, "%s(): unable allocate memory.", __func__);
+	pthread_cond_init(cond, NULL);
+#endif
+	return cond;
+}
+
+
+void system_cond_wait(void* cond, void* mutex)
+{
+#if _WIN32
+	SleepConditionVariableSRW((CONDITION_VARIABLE*)cond, (SRWLOCK*)mutex, INFINITE, 0);
+#else
+	pthread_cond_wait((pthread_cond_t*)cond, (pthread_mutex_t*)mutex);
+#endif
+}
+
+
+void system_cond_broadcast(void* cond)
+{
+#if _WIN32
+	WakeAllConditionVariable((CONDITION_VARIABLE*)cond);
+#else
+	pthread_cond_broadcast((pthread_cond_t*)cond);
+#endif
+}
+
+
+void system_cond_destroy(void* cond)
+{
+#if !_WIN32
+	pthread_cond_destroy((pthread_cond_t*)cond);
+#endif
+	free(cond);
+}
+
+
+void* system_mmap(FILE* file, size_t* length)
+{
+	fflush(file);
+#if _WIN32
+	HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+	LARGE_INTEGER size;
+	if (handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(handle, &size))
+		return NULL;
+	if (size.QuadPart == 0 || (unsigned long long)size.QuadPart > (size_t)-1)
+		return NULL;
+
+	HANDLE mapping = CreateFileMapping(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+		return NULL;
+	void* p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	/* The view keeps the mapping alive. */
+	CloseHandle(mapping);
+	if (p == NULL)
+		return NULL;
+	*length = (size_t)size.QuadPart;
+	return p;
+#else
+	struct stat s;
+	if (fstat(fileno(file), &s) != 0)
+		return NULL;
+	if (s.st_size <= 0 || (unsigned long long)s.st_size > (size_t)-1)
+		return NULL;
+
+	void* p = mmap(NULL, (size_t)s.st_size, PROT_READ, MAP_SHARED, fileno(file), 0);
+	if (p == MAP_FAILED)
+		return NULL;
+	*length = (size_t)s.st_size;
+	return p;
+#endif
+}
+
+
+void system_munmap(void* address, size_t length)
+{
+#if _WIN32
+	(void)length;
+	UnmapViewOfFile(address);
+#else
+	munmap(address, length);
+#endif
+}
+
+
+bool system_has_copy_range(void)
+{
+#ifdef __linux__
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+int64_t system_copy_range(FILE* in, int64_t inoffset, FILE* out, int64_t length)
+{
+	int64_t done = 0;
+#ifdef __linux__
+	if (fflush(out) != 0)
+		return 0;
+
+	int infd = fileno(in);
+	int outfd = fileno(out);
+	off_t inpos = (off_t)inoffset;
+	off_t outpos = ftello(out);
+	bool sendfile_only = false;
+
+	while (done < length) {
+		/* Keep each call well inside what the kernel will do in one go. */
+		size_t want = length - done > (1 << 30) ? (size_t)1 << 30 : (size_t)(length - done);
+		ssize_t n;
+
+		if (!sendfile_only) {
+			n = copy_file_range(infd, &inpos, outfd, &outpos, want, 0);
+			if (n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL
+			              || errno == EOPNOTSUPP || errno == EBADF)) {
+				debug("copy_file_range() unusable (%s), trying sendfile()", strerror(errno));
+				sendfile_only = true;
+				continue;
+			}
+		} else {
+			/* sendfile() writes at the file offset rather than taking one. */
+			if (lseek(outfd, outpos, SEEK_SET) < 0)
+				break;
+			n = sendfile(outfd, infd, &inpos, want);
+			if (n > 0)
+				outpos += n;
+		}
+		if (n <= 0) {
+			if (n < 0)
+				debug("in kernel copy stopped after %lld bytes: %s", (long long)done, strerror(errno));
+			break;
+		}
+		done += n;
+	}
+
+	/* Bring stdio up to date with where the kernel left things. */
+	fseeko(in, (off_t)(inoffset + done), SEEK_SET);
+	fseeko(out, outpos, SEEK_SET);
+#else
+	(void)in;
+	(void)inoffset;
+	(void)out;
+	(void)length;
+#endif
+	return done;
+}
+
+
+void system_binary_mode(FILE* file)
+{
+#if _WIN32
+	_setmode(_fileno(file), _O_BINARY);
+#else
+	(void)file;
+#endif
+}
+
+
+int system_seek(FILE* file, int64_t offset, int whence)
+{
+#if _WIN32
+	return _fseeki64(file, offset, whence);
+#else
+	return fseeko(file, (off_t)offset, whence);
+#endif
+}
+
+
+int64_t system_tell(FILE* file)
+{
+#if _WIN32
+	return _ftelli64(file);
+#else
+	return (int64_t)ftello(file);
+#endif
+}
+
+
+int system_truncate(FILE* file, int64_t length)
+{
+	if (fflush(file) != 0)
+		return -1;
+#if _WIN32
+	errno = _chsize_s(_fileno(file), length);
+	return errno == 0 ? 0 : -1;
+#else
+	return ftruncate(fileno(file), (off_t)length);
+#endif
+}
+
+
 bool system_isdir(const char* path)
 {
 	struct stat s;
@@ -176,6 +542,50 @@ bool system_isdir(const char* path)
 }
 
 
+int64_t system_filesize(const char* path)
+{
+	struct stat s;
+	if (stat(path, &s) != 0)
+		return -1;
+	return (int64_t)s.st_size;
+}
+
+
+/* Nanoseconds since the epoch when s was last modified, or just the seconds where that's all there is. */
+static int64_t mtime_of(const struct stat* s)
+{
+#if _WIN32
+	return (int64_t)s->st_mtime * 1000000000;
+#elif defined(__APPLE__)
+	return (int64_t)s->st_mtimespec.tv_sec * 1000000000 + s->st_mtimespec.tv_nsec;
+#else
+	return (int64_t)s->st_mtim.tv_sec * 1000000000 + s->st_mtim.tv_nsec;
+#endif
+}
+
+
+int64_t system_mtime(const char* path)
+{
+	struct stat s;
+	if (stat(path, &s) != 0)
+		return -1;
+	return mtime_of(&s);
+}
+
+
+void system_filestat(const char* path, int64_t* size, int64_t* mtime)
+{
+	struct stat s;
+	if (stat(path, &s) != 0) {
+		*size = -1;
+		*mtime = -1;
+		return;
+	}
+	*size = (int64_t)s.st_size;
+	*mtime = mtime_of(&s);
+}
+
+
 #if _WIN32
 /* Used to emulate the POSIX interface on top of the local hacks. */
 struct DirHandleWrapper {
@@ -238,6 +648,37 @@ SKIP_DOTS:
 }
 
 
+char* system_readdir_type(void* dirhandle, char* result, size_t max, bool* isdir)
+{
+#if _WIN32
+	if (system_readdir(dirhandle, result, max) == NULL)
+		return NULL;
+	struct DirHandleWrapper* wrapper = (struct DirHandleWrapper*)dirhandle;
+	*isdir = (wrapper->data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+	return result;
+#else
+	DIR* dir = (DIR*)dirhandle;
+	struct dirent* entry;
+	do {
+		entry = readdir(dir);
+		if (entry == NULL)
+			return NULL;
+	} while (strcmp("..", entry->d_name) == 0 || strcmp(".", entry->d_name) == 0);
+
+#ifdef DT_DIR
+	if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_LNK) {
+		*isdir = entry->d_type == DT_DIR;
+		return strncpy(result, entry->d_name, max);
+	}
+#endif
+	/* No type from the filesystem, or a link to follow: ask the inode. */
+	struct stat s;
+	*isdir = fstatat(dirfd(dir), entry->d_name, &s, 0) == 0 && S_ISDIR(s.st_mode);
+	return strncpy(result, entry->d_name, max);
+#endif
+}
+
+
 void system_closedir(void* dirhandle)
 {
 #if _WIN32
@@ -16,12 +16,18 @@
 #ifndef ZAR_SRC_SYSTEM__H
 #define ZAR_SRC_SYSTEM__H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 char* system_getcwd(char* out, size_t size);
 int system_chdir(const char* path);
 int system_mkdir(const char* path);
+/** Like mkdir(), so the parent must exist. An existing directory is success. */
+int system_mkdir_one(const char* path);
+/** Absolute path of an existing file, or NULL. Result must be free()'d. */
+char* system_realpath(const char* path);
 /** Similar to dirname(). Result must be free()'d. */
 char* system_dirname(const char* path);
 /** Similar to basename(). Result must be free()'d. */
@@ -32,12 +38,81 @@ const char* system_basename(const char* path);
  */
 char* system_fix_pathseps(char* path);
 
+/** Seconds since some arbitrary point. Only useful for measuring intervals. */
+double system_clock(void);
+
+/** Number of processors available, or 1 if that can't be determined. */
+size_t system_ncpus(void);
+
+/*
+ * Threads and their locks. Handles are opaque, like the ones from
+ * system_opendir(). Failures to create them call error().
+ */
+void* system_thread_start(void (*func)(void* arg), void* arg);
+void system_thread_join(void* thread);
+void* system_mutex_create(void);
+void system_mutex_lock(void* mutex);
+void system_mutex_unlock(void* mutex);
+void system_mutex_destroy(void* mutex);
+void* system_cond_create(void);
+/** Atomically unlock mutex, wait for a broadcast, and lock mutex again. */
+void system_cond_wait(void* cond, void* mutex);
+void system_cond_broadcast(void* cond);
+void system_cond_destroy(void* cond);
+
+/** Map all of an open file into memory, read only.
+ *
+ * Stores the size in length. Returns NULL if the file is empty, too big for
+ * the address space, or can't be mapped for any other reason.
+ */
+void* system_mmap(FILE* file, size_t* length);
+void system_munmap(void* address, size_t length);
+
+/** True if system_copy_range() can do anything on this platform. */
+bool system_has_copy_range(void);
+
+/** Copy length bytes from in, starting at inoffset, to out's current position.
+ *
+ * The data never passes through user space: copy_file_range() is tried
+ * first, which also lets filesystems like XFS and btrfs share extents, then
+ * sendfile(). Returns how many bytes were copied, which may be short or 0 if
+ * the kernel won't do it. Either way the stdio positions of in and out are
+ * left just past what was copied, so the caller can finish the job itself.
+ */
+int64_t system_copy_range(FILE* in, int64_t inoffset, FILE* out, int64_t length);
+
+/** Make sure file, such as stdin or stdout, doesn't translate line endings. */
+void system_binary_mode(FILE* file);
+
+/** Like fseek(), but with a 64-bit offset even where long is 32 bits. Returns 0, or -1 and sets errno. */
+int system_seek(FILE* file, int64_t offset, int whence);
+/** Like ftell(), but with a 64-bit offset even where long is 32 bits. */
+int64_t system_tell(FILE* file);
+
+/** Cut file off after its first length bytes, flushing it first. Returns 0, or -1 and sets errno. */
+int system_truncate(FILE* file, int64_t length);
+
 bool system_isdir(const char* path);
+/** Size of the file at path in bytes, or -1 if it can't be stat()'d. */
+int64_t system_filesize(const char* path);
+/** When the file at path was last modified, in nanoseconds since the epoch, or -1 if it can't be stat()'d.
+ *
+ * Windows only keeps whole seconds.
+ */
+int64_t system_mtime(const char* path);
+/** Size and modification time of the file at path from one stat(), or -1 for both if it can't be stat()'d. */
+void system_filestat(const char* path, int64_t* size, int64_t* mtime);
 void* system_opendir(const char* path);
 /** Like strncpy() over the name of the next directory entry.
  * If end of directory: NULL is returned and result is untouched.
  */
 char* system_readdir(void* dirhandle, char* result, size_t max);
+/** Like system_readdir(), and sets isdir if the entry is a directory.
+ *
+ * Uses the type readdir() hands back where the filesystem provides one, so
+ * there's usually no need to stat() the entry. Symbolic links are followed.
+ */
+char* system_readdir_type(void* dirhandle, char* result, size_t max, bool* isdir);
 void system_closedir(void* dirhandle);
 
 #endif
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "table.h"
+
+#include "debug.h"
+#include "sysexits.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+void table_init(ZarRecordTable* table)
+{
+	memset(table, 0, sizeof(*table));
+}
+
+
+void table_free(ZarRecordTable* table)
+{
+	free(table->paths);
+	free(table->starts);
+	free(table->lengths);
+	free(table->checksums);
+	free(table->formats);
+	free(table->sizes);
+	free(table->mtimes);
+	memset(table, 0, sizeof(*table));
+}
+
+
+static void* grow_column(void* column, size_t count, size_t size)
+{
+	void* p = realloc(column, count * size);
+	if (p == NULL)
+		error(EX_OSERR, "unable to allocate a table of %zu records", count);
+	return p;
+}
+
+
+void table_reserve(ZarRecordTable* table, size_t count)
+{
+	if (count <= table->capacity)
+		return;
+	table->paths = grow_column(table->paths, count, sizeof(*table->paths));
+	table->starts = grow_column(table->starts, count, sizeof(*table->starts));
+	table->lengths = grow_column(table->lengths, count, sizeof(*table->lengths));
+	table->checksums = grow_column(table->checksums, count, sizeof(*table->checksums));
+	table->formats = grow_column(table->formats, count, sizeof(*table->formats));
+	table->sizes = grow_column(table->sizes, count, sizeof(*table->sizes));
+	table->mtimes = grow_column(table->mtimes, count, sizeof(*table->mtimes));
+	table->capacity = count;
+}
+
+
+size_t table_add(ZarRecordTable* table, const char* path, ZarOffset_t start)
+{
+	if (table->count == table->capacity)
+		table_reserve(table, table->capacity ? 2 * table->capacity : 64);
+
+	size_t row = table->count++;
+	table->paths[row] = path;
+	table->starts[row] = start;
+	table->lengths[row] = -1;
+	table->checksums[row] = 0;
+	table->formats[row][0] = (char)0xDE;
+	table->formats[row][1] = (char)0xAD;
+	table->sizes[row] = -1;
+	table->mtimes[row] = -1;
+	return row;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZAR_SRC_TABLE__H
+#define ZAR_SRC_TABLE__H
+
+#include "io.h"
+
+#include <stddef.h>
+
+void table_init(ZarRecordTable* table);
+void table_free(ZarRecordTable* table);
+
+/** Makes room for count rows in every column, so adding them won't reallocate. */
+void table_reserve(ZarRecordTable* table, size_t count);
+
+/** Appends a row for the record of path at start, with the rest unknown.
+ *
+ * Returns the row's number.
+ */
+size_t table_add(ZarRecordTable* table, const char* path, ZarOffset_t start);
+
+#endif
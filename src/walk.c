@@ -0,0 +1,197 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "walk.h"
+
+#include "debug.h"
+#include "io.h"
+#include "pool.h"
+#include "sysexits.h"
+#include "system.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Names found in a directory, packed one after another with their NULs. */
+typedef struct {
+	char* data;
+	size_t length;
+	size_t capacity;
+	size_t count;
+} WalkNames;
+
+
+typedef struct {
+	char* path;
+	WalkNames files;
+	WalkNames subdirs;
+	/* Where this directory's subdirectories start in Walk::dirs. */
+	size_t first;
+	size_t nsubdirs;
+} WalkDir;
+
+
+struct Walk {
+	/* Every directory found, a level at a time. */
+	WalkDir* dirs;
+	size_t ndirs;
+	size_t capacity;
+	/* First directory of the level being read. */
+	size_t level;
+};
+
+
+static void names_add(WalkNames* names, const char* name)
+{
+	size_t n = strlen(name) + 1;
+	if (names->length + n > names->capacity) {
+		size_t capacity = names->capacity ? names->capacity : 256;
+		while (capacity < names->length + n)
+			capacity *= 2;
+		char* p = realloc(names->data, capacity);
+		if (p == NULL)
+			error(EX_OSERR, "unable to allocate %zu bytes for directory entries", capacity);
+		names->data = p;
+		names->capacity = capacity;
+	}
+	memcpy(names->data + names->length, name, n);
+	names->length += n;
+	names->count++;
+}
+
+
+/* dir + '/' + name into out, which is ZAR_MAX_PATH long. */
+static char* join_path(char* out, const char* dir, const char* name)
+{
+	size_t n = strlen(dir);
+	bool slash = n > 0 && dir[n-1] != '/';
+	if (n + slash + strlen(name) + 1 > ZAR_MAX_PATH)
+		error(EX_DATAERR, "%s/%s: path is too long.", dir, name);
+	memcpy(out, dir, n);
+	if (slash)
+		out[n++] = '/';
+	strcpy(out + n, name);
+	return out;
+}
+
+
+static void add_dir(struct Walk* walk, const char* path)
+{
+	if (walk->ndirs == walk->capacity) {
+		walk->capacity = walk->capacity ? 2 * walk->capacity : 64;
+		walk->dirs = realloc(walk->dirs, walk->capacity * sizeof(WalkDir));
+		if (walk->dirs == NULL)
+			error(EX_OSERR, "unable to allocate %zu directories", walk->capacity);
+	}
+	WalkDir* dir = &walk->dirs[walk->ndirs++];
+	memset(dir, 0, sizeof(*dir));
+	dir->path = malloc(strlen(path) + 1);
+	if (dir->path == NULL)
+		error(EX_OSERR, "%s(): unable allocate memory.", __func__);
+	strcpy(dir->path, path);
+}
+
+
+static void read_dir(WalkDir* dir)
+{
+	debug("reading directory %s", dir->path);
+	void* handle = system_opendir(dir->path);
+	if (handle == NULL)
+		error(EX_IOERR, "%s: cannot open directory: %s", dir->path, strerror(errno));
+
+	char name[ZAR_MAX_PATH];
+	bool isdir = false;
+	while (system_readdir_type(handle, name, sizeof(name), &isdir) != NULL)
+		names_add(isdir ? &dir->subdirs : &dir->files, name);
+	system_closedir(handle);
+}
+
+
+static void read_dir_job(void* context, size_t index)
+{
+	struct Walk* walk = context;
+	read_dir(&walk->dirs[walk->level + index]);
+}
+
+
+void walk_directories(char* const roots[], size_t nroots, size_t nthreads,
+                      ZarWalkFunc func, void* context)
+{
+	struct Walk walk;
+	memset(&walk, 0, sizeof(walk));
+	for (size_t i=0; i < nroots; ++i)
+		add_dir(&walk, roots[i]);
+
+	char path[ZAR_MAX_PATH];
+	size_t level = 0;
+	while (level < walk.ndirs) {
+		size_t end = walk.ndirs;
+		size_t n = end - level;
+		if (nthreads > 1 && n > 1) {
+			walk.level = level;
+			ZarPool* pool = pool_start(nthreads < n ? nthreads : n, n, 0, read_dir_job, &walk);
+			pool_finish(pool);
+		} else {
+			for (size_t i=level; i < end; ++i)
+				read_dir(&walk.dirs[i]);
+		}
+
+		/* Queue up the next level. add_dir() may move dirs, but not what they point to. */
+		for (size_t i=level; i < end; ++i) {
+			WalkNames subdirs = walk.dirs[i].subdirs;
+			const char* parent = walk.dirs[i].path;
+			walk.dirs[i].first = walk.ndirs;
+			walk.dirs[i].nsubdirs = subdirs.count;
+			const char* name = subdirs.data;
+			for (size_t k=0; k < subdirs.count; ++k) {
+				add_dir(&walk, join_path(path, parent, name));
+				name += strlen(name) + 1;
+			}
+			free(subdirs.data);
+			memset(&walk.dirs[i].subdirs, 0, sizeof(WalkNames));
+		}
+		level = end;
+	}
+	debug("walked %zu directories", walk.ndirs);
+
+	/* Depth first, with a stack instead of recursion. */
+	size_t* stack = malloc((walk.ndirs ? walk.ndirs : 1) * sizeof(size_t));
+	if (stack == NULL)
+		error(EX_OSERR, "unable to allocate walk of %zu directories", walk.ndirs);
+	size_t top = 0;
+	for (size_t i=nroots; i > 0; --i)
+		stack[top++] = i - 1;
+	while (top > 0) {
+		WalkDir* dir = &walk.dirs[stack[--top]];
+		const char* name = dir->files.data;
+		for (size_t k=0; k < dir->files.count; ++k) {
+			func(context, join_path(path, dir->path, name));
+			name += strlen(name) + 1;
+		}
+		for (size_t k=dir->nsubdirs; k > 0; --k)
+			stack[top++] = dir->first + k - 1;
+	}
+	free(stack);
+
+	for (size_t i=0; i < walk.ndirs; ++i) {
+		free(walk.dirs[i].path);
+		free(walk.dirs[i].files.data);
+	}
+	free(walk.dirs);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2016-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZAR_SRC_WALK__H
+#define ZAR_SRC_WALK__H
+
+#include <stddef.h>
+
+/** Called with the path of every file found. */
+typedef void (*ZarWalkFunc)(void* context, const char* path);
+
+/** Finds every file below the directories in roots.
+ *
+ * Directories are read a level at a time, on up to nthreads threads when a
+ * level has more than one. Nothing recurses, so depth doesn't matter.
+ *
+ * Once everything has been read, func is called on this thread for each
+ * file, depth first: a directory's files in the order they were read, then
+ * each of its subdirectories the same way. The order doesn't depend on
+ * nthreads. Calls error() if a directory can't be opened.
+ */
+void walk_directories(char* const roots[], size_t nroots, size_t nthreads,
+                      ZarWalkFunc func, void* context);
+
+#endif